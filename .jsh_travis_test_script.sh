@@ -17,6 +17,9 @@ echo "this is the output of \"ll | grep alias\"" && ll | grep alias
 
 echo -e "\\nthis is the output of \"ll | grep alias | wc\"" && ll | grep alias | wc
 
+lh() { ll jsh-man.1 ; echo "^ the output of function \"lh\" calling alias \"ll\"" ; }
+echo -e "\\nthis is the output of function \"lh\":" && lh
+
 echo -e "\\nnow triggering some error messages: "
 
 # a long comment: loooooooooooooooooooooooooooooooooooooooooooooooooooooooooooo ooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooo ooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooo ooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooo ooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooong
@@ -18,63 +18,116 @@
  */
 
 #include "alias.h"
+#include <stdint.h>
 
-#define MAX_ALIAS_VAL_LENGTH    200 // the maximum allowed number of chars per alias value
 #define MAX_ALIAS_KEY_LENGTH    50  // the maximum allowed number of chars per alias key
+#define ALIAS_TABLE_MIN_SIZE    64  // the initial nb of slots in the alias hash table; a power of 2
+#define MAX_ALIAS_DEPTH         16  // the maximum nesting depth of aliases expanded within alias values
+#define ALIAS_TOMBSTONE         ((struct alias*) &alias_tombstone) // marks a slot of a removed alias
 
+/*
+ * An alias is a single allocation holding both its key and value strings; the same pointer is
+ *  shared by its hash table slot and its entry in the sorted key view.
+ */
 struct alias {
-    char *key;
-    char *value;
-    struct alias *next;
+    char *value;    // points into the key[] allocation, right after the key's '\0'
+    size_t vallen;
+    char key[];
 };
-//typedef struct alias ALIAS;
-//#define CREATE_ALIAS(k,v) (struct alias) {k, v}
 
-struct alias *head = NULL;
-struct alias *tail = NULL;
+/*
+ * The alias store: an open addressing hash table with linear probing, plus a view on the same
+ *  aliases sorted by key, that is maintained incrementally for completion.
+ */
+struct {
+    struct alias **slots;   // NULL (free), ALIAS_TOMBSTONE (removed) or an alias
+    size_t size;            // nb of slots; a power of 2
+    size_t used;            // nb of non-NULL slots, tombstones included
+    struct alias **sorted;  // the aliases sorted by key
+    size_t nb;              // nb of aliases
+    size_t cap;             // allocated length of the sorted array
+} aliases = {NULL, 0, 0, NULL, 0, 0};
 
-int total_alias_val_length = 0;
-int nb_aliases = 0;
+/*
+ * the growable output buffer of alias expansion
+ */
+struct expansion {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+char alias_tombstone;
+unsigned long generation = 0;   // incremented on every alias table change
 
-bool alias_key_changed = false;
+// #################### helper function definitions ####################
+size_t alias_probe(const char*, bool*);
+void alias_rehash(void);
+size_t alias_bound(const char*, size_t, bool);
+struct alias *alias_find(const char*);
+void expand_aliases(const char*, struct expansion*, struct alias**, int);
+void expand_tilde(const char*, struct token*, struct expansion*);
+void expansion_append(struct expansion*, const char*, size_t);
 
 /*
  * alias: create a mapping between a key and value pair that can be resolved with resolvealiases().
  *  returns EXIT_SUCCESS or EXIT_FAILURE if something went wrong (e.g. malloc)
- *  (note that provided strings that are too long are silently truncated)
+ *  (note that keys longer than MAX_ALIAS_KEY_LENGTH chars are silently truncated; values can be
+ *  of any length)
  */
 int alias(char *k, char *v) {
     // allow recursive alias definitions
     char *val = resolvealiases(v);
 
-    int vallength = strnlen(val, MAX_ALIAS_VAL_LENGTH);
-    int keylength = strnlen(k, MAX_ALIAS_KEY_LENGTH);
-    
-    // alloc memory for the new alias struct and its key
-    // note: *val has already been alloced by the resolvealiases() call
-    struct alias *new = malloc(sizeof(struct alias)); //TODO chkerr
-    new->next = NULL;
-    new->key = malloc(sizeof (char) * keylength+1);
-    
-    // copy the provided strings into the allocated memory
-    strncpy(new->key, k, keylength+1);
-    new->value = val;
-    
-    if(alias_exists(k)) {
-        unalias(k);
+    size_t vallength = strlen(val);
+    size_t keylength = strnlen(k, MAX_ALIAS_KEY_LENGTH);
+
+    // alloc a single chunk of memory for the new alias and copy its key and value
+    struct alias *new = malloc(sizeof(struct alias) + keylength + vallength + 2);
+    if (!new) {
+        printerrno("alias: malloc");
+        free(val);
+        return EXIT_FAILURE;
+    }
+    memcpy(new->key, k, keylength);
+    new->key[keylength] = '\0';
+    new->value = new->key + keylength + 1;
+    memcpy(new->value, val, vallength + 1);
+    new->vallen = vallength;
+    free(val);
+
+    // keep the load factor (tombstones included) below 1/2, so probing always ends
+    if ((aliases.used + 1) * 2 > aliases.size)
+        alias_rehash();
+
+    bool found;
+    size_t slot = alias_probe(new->key, &found);
+    size_t pos = alias_bound(new->key, keylength + 1, false);
+    if (found) {
+        // redefinition: replace the alias in place, both in the table and the sorted view
+        free(aliases.slots[slot]);
+        aliases.sorted[pos] = new;
+    }
+    else {
+        if (aliases.nb == aliases.cap) {
+            size_t cap = aliases.cap ? aliases.cap * 2 : ALIAS_TABLE_MIN_SIZE;
+            struct alias **sorted = realloc(aliases.sorted, sizeof(struct alias*) * cap);
+            if (!sorted) {
+                printerrno("alias: realloc");
+                free(new);
+                return EXIT_FAILURE;
+            }
+            aliases.sorted = sorted;
+            aliases.cap = cap;
+        }
+        memmove(aliases.sorted + pos + 1, aliases.sorted + pos, sizeof(struct alias*) * (aliases.nb - pos));
+        aliases.sorted[pos] = new;
+        aliases.nb++;
+        if (!aliases.slots[slot])
+            aliases.used++;
     }
-	total_alias_val_length += vallength;
-
-    if (head == NULL) {
-	    head = new;
-	    tail = head;
-	}
-	else {
-	    tail->next = new;
-	    tail = new;
-	}
-	nb_aliases++;
-	alias_key_changed = true;
+    aliases.slots[slot] = new;
+    generation++;
     return EXIT_SUCCESS;
 }
 
@@ -83,150 +136,293 @@ int alias(char *k, char *v) {
  *  returns EXIT_SUCCESS if the specified key was found; else prints an error message and returns EXIT_FAILURE 
  */
 int unalias(char *key) {
-    struct alias *cur = head;
-    struct alias *prev = NULL;
-    while (cur != NULL) {
-        if (strncmp(cur->key, key, MAX_ALIAS_KEY_LENGTH) == 0) {
-            // re-organize the linked list
-            if (prev)
-                prev->next = cur->next;
-            else
-                head = cur->next;
-            if (cur == tail)
-                tail = prev;
-            // free the unalised alias and return
-            total_alias_val_length -= strnlen(cur->value, MAX_ALIAS_VAL_LENGTH);
-            free(cur);
-            nb_aliases--;
-            alias_key_changed = true;
-            return EXIT_SUCCESS;;
-        }
-        prev = cur;
-        cur = cur->next;
+    bool found = false;
+    size_t slot = aliases.size ? alias_probe(key, &found) : 0;
+    if (!found) {
+        printerr("unalias: no such alias key: %s", key);
+        return EXIT_FAILURE;
     }
-    printerr("unalias: no such alias key: %s", key);
-    return EXIT_FAILURE;
+
+    struct alias *cur = aliases.slots[slot];
+    size_t pos = alias_bound(cur->key, strlen(cur->key) + 1, false);
+    memmove(aliases.sorted + pos, aliases.sorted + pos + 1, sizeof(struct alias*) * (aliases.nb - pos - 1));
+    aliases.nb--;
+    // the slot may be part of another key's probe sequence; leave a tombstone
+    aliases.slots[slot] = ALIAS_TOMBSTONE;
+    generation++;
+    free(cur);
+    return EXIT_SUCCESS;
 }
 
 /*
- * printaliases: print a list of all currently set aliases on stdout
+ * printaliases: print a list of all currently set aliases, sorted by key, on stdout
  * returns EXIT_SUCCESS
  */
 int printaliases() {
-    struct alias *cur = head;
-    while(cur != NULL) {
-        printf("alias %s = '%s'\n", cur->key, cur->value);
-        cur = cur->next;
-    }
+    size_t i;
+    for (i = 0; i < aliases.nb; i++)
+        printf("alias %s = '%s'\n", aliases.sorted[i]->key, aliases.sorted[i]->value);
     return EXIT_SUCCESS;
 }
 
 /*
- * get_all_alias_keys: returns a newly malloced array of pointers to newly malloced strings
- *  containing a copy of the alias keys.
- * @param nb_keys           : if non-NULL; will contain the length of the result array;
- *  nb_keys will be untouched if NULL is returned
- * @param only_on_change    : if true, the result will only be non-NULL if one of the alias
- *  keys changed since the last time this method was called.
- * @return: an array with all alias key strings, or NULL iff @param(only_on_change) and
- *  there have been no alias key changes since the last time this method was called.
- * @note: the caller is responisble for freeing the array as well as the array elements
+ * alias_lookup: returns the value of the specified alias key, or NULL iff it isn't aliased.
+ * @note: the returned string is owned by the alias store and only valid until the key is
+ *  redefined or unaliased
  */
-char **get_all_alias_keys(unsigned int *nb_keys, bool only_on_change) {
-    if (only_on_change && !alias_key_changed) {
-        return NULL;
-    }
-    
-    char **ret = malloc(sizeof(char*) * nb_aliases);
-
-    int i = 0;
-    struct alias *cur = head;
-    while(cur != NULL) {
-        ret[i] = strclone(cur->key);
-        cur = cur->next;
-        i++;
-    }
-    if (nb_keys) *nb_keys = nb_aliases;
-    alias_key_changed = false;
-    return ret;
+const char *alias_lookup(const char *key) {
+    struct alias *a = alias_find(key);
+    return a ? a->value : NULL;
+}
+
+/*
+ * alias_generation: returns a counter that changes on every alias() or unalias() call that
+ *  changes the alias table, e.g. to invalidate cached alias expansions
+ */
+unsigned long alias_generation(void) {
+    return generation;
 }
 
+/*
+ * alias_prefix_range: returns the index in the sorted key view of the first alias key that
+ *  starts with the provided prefix; @param(nb) will contain the nb of such keys. These keys
+ *  can be accessed in order with alias_key().
+ */
+size_t alias_prefix_range(const char *prefix, size_t *nb) {
+    size_t len = strlen(prefix);
+    size_t first = alias_bound(prefix, len, false);
+    *nb = alias_bound(prefix, len, true) - first;
+    return first;
+}
+
+/*
+ * alias_key: returns the alias key at the specified index of the sorted key view, or NULL iff
+ *  out of range.
+ * @note: the returned string is owned by the alias store and only valid until the next
+ *  alias() or unalias() call
+ */
+const char *alias_key(size_t i) {
+    return (i < aliases.nb) ? aliases.sorted[i]->key : NULL;
+}
 
 /*
  * resolvealiases: substitutes all known aliases in the inputstring. Returns a pointer to the alias-expanded string.
  *  NOTE: this function returns a pointer to a newly malloced() string. The caller should free() it afterwards, 
  *        as well as also the inputstring *s, if needed
  *
+ *  The line is split into tokens by the lexer; only unquoted words in command position (at the
+ *  start of a command, or after 'sudo' or 'time' there) are looked up, each with a single hash
+ *  probe, so the cost doesn't depend on the nb of defined aliases. An alias value is expanded
+ *  again, up to MAX_ALIAS_DEPTH levels deep, except for the aliases that are already being
+ *  expanded. Keys starting with '~' are expanded at the start of any word, up to the first '/'.
+ *
  *  current limitations for aliases:
  * TODO - any spaces in the value must be escaped in the input for the 'alias' cmd    e.g. alias ls ls\ --color=auto
  *                                                                                    alt syntax: alias ls "ls --color=auto"
  */
 char *resolvealiases(char *s) {
-    bool is_valid_alias(char*, char*, int); // helper function def
-
-    // alloc enough space for the return value
-    int maxsize = strlen(s) + total_alias_val_length; 
-    char *ret = malloc(sizeof (char) * maxsize);
-    strcpy(ret, s);
-    
-    // find all alias key substrings, replacing them if valid in context
+    // most lines expand to about their own length: start with room for that
+    struct expansion out = {NULL, 0, strlen(s) + 1};
+    struct alias *chain[MAX_ALIAS_DEPTH];
+    if (!(out.buf = malloc(out.size))) {
+        printerrno("alias: malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // the tokens are only needed during expansion: release them right away
+    arena_mark mark = arena_save(&line_arena);
+    expand_aliases(s, &out, chain, 0);
+    arena_release(&line_arena, mark);
+    expansion_append(&out, "", 1);
+
+    printdebug("alias: input resolved to: '%s'", out.buf);
+    return out.buf;
+}
+
+/*
+ * alias_exists: returns whether or not a specified key is currently aliased.
+ * @return true if the supplied alias already exists; else false.
+ */
+bool alias_exists(char* key) {
+    return alias_lookup(key) != NULL;
+}
+
+/*
+ * alias_probe: returns the hash table slot of the alias with the specified key and sets
+ *  @param(found) iff it exists; else returns the slot where it should be inserted (the first
+ *  tombstone on its probe sequence, if any) and clears @param(found).
+ * @note: the table should be non-empty and contain at least one free slot
+ */
+size_t alias_probe(const char *key, bool *found) {
+    size_t mask = aliases.size - 1, i, insert = SIZE_MAX;
     struct alias *cur;
-    char *p, *str; // p is pointer to matched substring; str is pointer to not-yet-checked string
-    for (cur = head; cur != NULL; cur = cur->next)
-        for (str = ret; (p = strstr(str, cur->key)) != NULL;) {
-            if (is_valid_alias(cur->key, ret, p-ret)) {
-                printdebug("alias: '%s' VALID in context '%s'", cur->key, p);
-                
-                char *after = p + strlen(cur->key);
-                memmove(p + strlen(cur->value), after, strlen(after)+1); // overlapping mem; len+1 : also copy the '\0'
-                memcpy(p, cur->value, strlen(cur->value)); // non-overlapping mem
-                str = p+strlen(cur->value);
+    for (i = hash_string(key) & mask; (cur = aliases.slots[i]); i = (i + 1) & mask)
+        if (cur == ALIAS_TOMBSTONE) {
+            if (insert == SIZE_MAX)
+                insert = i;
+        }
+        else if (strcmp(cur->key, key) == 0) {
+            *found = true;
+            return i;
+        }
+    *found = false;
+    return (insert != SIZE_MAX) ? insert : i;
+}
+
+/*
+ * alias_rehash: reinserts all aliases in a newly allocated hash table that is large enough
+ *  for the current nb of aliases plus one, dropping all tombstones
+ */
+void alias_rehash(void) {
+    size_t size = ALIAS_TABLE_MIN_SIZE, i, j;
+    while (size < (aliases.nb + 1) * 4)
+        size <<= 1;
+    struct alias **slots = calloc(size, sizeof(struct alias*));
+    if (!slots) {
+        printerrno("alias: calloc");
+        exit(EXIT_FAILURE);
+    }
+    // the sorted view holds all live aliases; no need to scan the old slots
+    for (i = 0; i < aliases.nb; i++) {
+        for (j = hash_string(aliases.sorted[i]->key) & (size - 1); slots[j]; j = (j + 1) & (size - 1))
+            ;
+        slots[j] = aliases.sorted[i];
+    }
+    free(aliases.slots);
+    aliases.slots = slots;
+    aliases.size = size;
+    aliases.used = aliases.nb;
+}
+
+/*
+ * alias_bound: binary searches the sorted key view for the first alias key whose first
+ *  @param(len) chars compare greater than (iff @param(upper)) or greater than or equal to
+ *  those of the provided key. With len = strlen(key) + 1 this is the position of the key itself.
+ */
+size_t alias_bound(const char *key, size_t len, bool upper) {
+    size_t lo = 0, hi = aliases.nb, mid;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        int cmp = strncmp(aliases.sorted[mid]->key, key, len);
+        if (cmp < 0 || (upper && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * alias_find: returns the alias with the specified key, or NULL iff it isn't aliased
+ */
+struct alias *alias_find(const char *key) {
+    bool found = false;
+    size_t slot = aliases.size ? alias_probe(key, &found) : 0;
+    return found ? aliases.slots[slot] : NULL;
+}
+
+/*
+ * expand_aliases: appends the provided line to the output buffer with the aliases in command
+ *  position substituted. @param(chain) holds the @param(depth) aliases whose values are
+ *  currently being expanded; these aren't expanded again.
+ * @note: the '{' of a function definition 'name() {' is a command position, like ';', so the
+ *  aliases in a function body are all bound when the function is defined
+ */
+void expand_aliases(const char *line, struct expansion *out, struct alias **chain, int depth) {
+    struct tokens ts;
+    size_t i, copied = 0;
+    bool cmd_pos = true;
+    int j;
+
+    lex(line, &ts, &line_arena);
+    for (i = 0; i < ts.nb; i++) {
+        struct token *t = &ts.toks[i];
+        if (t->type != TOK_WORD) {
+            // the next word starts a new command, except after a redirection or ')'
+            cmd_pos = (t->type <= TOK_LPAREN);
+            continue;
+        }
+
+        // the '{' starting a function body: the next word starts a new command
+        if (!t->quoted && strcmp(t->text, "{") == 0 && i >= 3 && ts.toks[i-1].type == TOK_RPAREN &&
+                ts.toks[i-2].type == TOK_LPAREN && ts.toks[i-3].type == TOK_WORD) {
+            cmd_pos = true;
+            continue;
+        }
+
+        struct alias *a = NULL;
+        if (cmd_pos && !t->quoted && (a = alias_find(t->text)))
+            for (j = 0; j < depth; j++)
+                if (chain[j] == a) {
+                    a = NULL;
+                    break;
                 }
+        cmd_pos = cmd_pos && !t->quoted && (strcmp(t->text, "sudo") == 0 || strcmp(t->text, "time") == 0);
+
+        if (a) {
+            printdebug("alias: '%s' VALID at index %zu", a->key, t->start);
+            expansion_append(out, line + copied, t->start - copied);
+            if (depth < MAX_ALIAS_DEPTH) {
+                chain[depth] = a;
+                expand_aliases(a->value, out, chain, depth + 1);
+            }
             else {
-                printdebug("alias: '%s' INVALID in context '%s'", cur->key, p);
-                str = p+strlen(cur->key);
+                printerr("alias: '%s': maximum nesting depth (%d) exceeded", a->key, MAX_ALIAS_DEPTH);
+                expansion_append(out, a->value, a->vallen);
             }
+            copied = t->end;
         }
-    
-    printdebug("alias: input resolved to: '%s'", ret);
-    return ret;
+        else if (line[t->start] == '~') {
+            expansion_append(out, line + copied, t->start - copied);
+            expand_tilde(line, t, out);
+            copied = t->end;
+        }
+    }
+    expansion_append(out, line + copied, strlen(line + copied));
 }
 
-/* 
- * is_valid_alias: returns whether or not an occurence of an alias key is valid (i.e. must be 
- *  replaced by its value) in a given context string. An alias match is valid iff it occurs 
- *  as a comd in the grammar and it's not '\' escaped.
- *
- *  @param key: the alias key corresponding to the alias that is matched
- *  @param context: the context string where the alias is matched
- *  @param i: the index in the context string where the alias is matched: context+i equals alias->key
- */
-bool is_valid_alias(char *key, char *context, int i) {
-    // allow escaping '\' of aliases TODO is this usefull? --> yes for the ~ alias hack
-    if ( i > 0 && *(context+i-1) == '\\' ) {
-        printdebug("alias: escaping '%s'", key);
-        memmove(context+i-1, context+i, strlen(context+i)+1); //TODO this function shouldn't change the given context
-        return false;
+/*
+ * expand_tilde: appends the source of the provided word, that starts with an unquoted '~', to
+ *  the output buffer with its unquoted prefix up to the first '/' substituted iff it's an alias
+ *  key (e.g. the built-in '~' alias for the home directory)
+ */
+void expand_tilde(const char *line, struct token *t, struct expansion *out) {
+    char key[MAX_ALIAS_KEY_LENGTH + 1];
+    size_t n = 0;
+    struct alias *a;
+
+    while (t->start + n < t->end && line[t->start + n] != '/') {
+        char c = line[t->start + n];
+        if (c == '"' || c == '\\' || n == MAX_ALIAS_KEY_LENGTH) {
+            n = 0;  // a quoted or too long prefix isn't an alias key
+            break;
+        }
+        key[n++] = c;
+    }
+    key[n] = '\0';
+    if (n > 0 && (a = alias_find(key))) {
+        expansion_append(out, a->value, a->vallen);
+        expansion_append(out, line + t->start + n, t->end - t->start - n);
     }
-    
-    // built_in aliases are valid in any context TODO unless escaped...
-    if (*key == '~')
-        return true;
-    
-    return is_valid_cmd(key, context, i);
+    else
+        expansion_append(out, line + t->start, t->end - t->start);
 }
 
 /*
- * alias_exists: returns whether or not a specified key is currently aliased.
- * @return true if the supplied alias already exists; else false.
+ * expansion_append: appends @param(n) chars of the provided string to the output buffer,
+ *  doubling its size iff needed
  */
-bool alias_exists(char* key) {
-	if (!head) return false;
-
-	struct alias *curAlias;
-    for (curAlias = head; curAlias != NULL; curAlias = curAlias->next) {
-		// If the current alias matches the argument, return true.
-		if (strcmp(curAlias->key, key) == 0) return true;
-	}
-	return false;
+void expansion_append(struct expansion *out, const char *s, size_t n) {
+    if (out->len + n > out->size) {
+        size_t size = out->size ? out->size : 64;
+        while (out->len + n > size)
+            size *= 2;
+        if (!(out->buf = realloc(out->buf, size))) {
+            printerrno("alias: realloc");
+            exit(EXIT_FAILURE);
+        }
+        out->size = size;
+    }
+    memcpy(out->buf + out->len, s, n);
+    out->len += n;
 }
@@ -29,5 +29,8 @@ int unalias(char* key);
 int printaliases();
 char *resolvealiases(char*);
 bool alias_exists(char*);
-char **get_all_alias_keys(unsigned int*, bool);
+const char *alias_lookup(const char*);
+unsigned long alias_generation(void);
+size_t alias_prefix_range(const char*, size_t*);
+const char *alias_key(size_t);
 #endif //ALIAS_H_INCLUDED
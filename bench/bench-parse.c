@@ -0,0 +1,195 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * bench-parse.c: parser throughput benchmark. Drives the lexer, parser and alias expansion
+ *  in-process on a generated stress corpus, without executing any command, and reports the
+ *  parse cost in ns/byte and the number of allocations per line. Build and run with
+ *  'make bench-parse'; the malloc family is counted with the linker's --wrap option.
+ * ----------------------------------------------------------------------
+ */
+
+#include "../jsh-parse.h"
+#include <time.h>
+
+#define BENCH_MIN_TIME          0.25    // min nb of seconds to repeat each corpus line for
+#define BENCH_MIN_ITERS         3       // min nb of repetitions of each corpus line
+#define BENCH_NB_ALIASES        5000    // nb of aliases defined for the last alias expansion run
+
+// ########## stubs for the jsh.c globals the parser links against ##########
+bool DEBUG = false;
+bool COLOR = false;
+bool I_AM_FORK = false;
+bool IS_INTERACTIVE = false;
+bool WAITING_FOR_CHILD = false;
+
+int is_built_in(comd *comd) {
+    return -1;
+}
+
+int parse_built_in(comd *comd, int index) {
+    return EXIT_FAILURE;
+}
+
+// ########## malloc family call counting ##########
+unsigned long nb_mallocs = 0;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void*, size_t);
+
+void *__wrap_malloc(size_t size) {
+    nb_mallocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    nb_mallocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    nb_mallocs++;
+    return __real_realloc(ptr, size);
+}
+
+// ########## corpus generation ##########
+/*
+ * repeat: returns a newly malloced string: prefix, n times unit and suffix
+ */
+char *repeat(const char *prefix, const char *unit, int n, const char *suffix) {
+    size_t plen = strlen(prefix), ulen = strlen(unit), slen = strlen(suffix);
+    char *rv = malloc(plen + n * ulen + slen + 1), *cur = rv;
+    memcpy(cur, prefix, plen);
+    cur += plen;
+    while (n-- > 0) {
+        memcpy(cur, unit, ulen);
+        cur += ulen;
+    }
+    memcpy(cur, suffix, slen + 1);
+    return rv;
+}
+
+/*
+ * nested: returns a newly malloced string with depth nested groups around a command
+ */
+char *nested(int depth) {
+    char *open = repeat("", "(", depth, "");
+    char *close = repeat("T", ")", depth, "");
+    char *rv = concat(2, open, close);
+    free(open);
+    free(close);
+    return rv;
+}
+
+// ########## benchmark driver ##########
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * bench_parse: lexes and parses the provided line repeatedly and prints the results
+ */
+void bench_parse(const char *name, const char *line, struct arena *a) {
+    size_t len = strlen(line);
+    unsigned long iters = 0, mallocs = nb_mallocs, arena_allocs = 0;
+    size_t arena_bytes = 0;
+    double start = now(), elapsed;
+
+    do {
+        arena_mark mark = arena_save(a);
+        size_t allocs = a->nb_allocs;
+        if (!parse(line, a, NULL)) {
+            printf("%-22s parse error\n", name);
+            return;
+        }
+        arena_allocs += a->nb_allocs - allocs;
+        arena_bytes = a->used - mark.used;
+        arena_release(a, mark);
+        iters++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME || iters < BENCH_MIN_ITERS);
+
+    printf("%-22s %9zu %9.2f %12.1f %13.1f %12zu\n", name, len, elapsed * 1e9 / (iters * len),
+        (double) (nb_mallocs - mallocs) / iters, (double) arena_allocs / iters, arena_bytes);
+}
+
+/*
+ * bench_alias: expands the aliases in the provided line repeatedly and prints the results
+ */
+void bench_alias(const char *name, char *line) {
+    size_t len = strlen(line);
+    unsigned long iters = 0, mallocs = nb_mallocs;
+    double start = now(), elapsed;
+
+    do {
+        free(resolvealiases(line));
+        iters++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME || iters < BENCH_MIN_ITERS);
+
+    printf("%-22s %9zu %9.2f %12.1f %13s %12s\n", name, len, elapsed * 1e9 / (iters * len),
+        (double) (nb_mallocs - mallocs) / iters, "-", "-");
+}
+
+int main(int argc, char **argv) {
+    struct arena a = ARENA_INIT;
+    struct {
+        const char *name;
+        char *line;
+    } corpus[] = {
+        {"simple",          strclone("ls / -l >> out.txt && cat < out.txt | grep --color=auto -B 2 usr ; pwd")},
+        {"long-args",       repeat("echo", " argument", 20000, "")},
+        {"long-and-or",     repeat("T", " && T || F", 10000, "")},
+        {"long-list",       repeat("T", " ; echo x", 10000, "")},
+        {"long-pipeline",   repeat("cat", " | grep x", 5000, "")},
+        {"nested-1000",     nested(1000)},
+        {"quoting",         repeat("echo", " \"a \\\"quoted\\\" ; && | word\" es\\ caped\\;\\&", 5000, "")},
+        {"redirections",    repeat("cmd", " < in > out >> app 2> err", 5000, "")},
+        {"comment",         repeat("echo hi #", " (comment) && ;", 5000, "")},
+    };
+    size_t i, nb = sizeof(corpus) / sizeof(corpus[0]);
+
+    printf("%-22s %9s %9s %12s %13s %12s\n", "corpus", "bytes", "ns/byte", "mallocs/line",
+        "arena allocs", "arena bytes");
+    for (i = 0; i < nb; i++)
+        bench_parse(corpus[i].name, corpus[i].line, &a);
+
+    // alias expansion runs on the raw line before parsing
+    alias("ll", "ls -lh");
+    alias("grep", "grep --color=auto -i");
+    char *aliased = repeat("ll | grep x ;", " echo argument", 5000, "");
+    char *repeated = repeat("ll", " ; ll | grep x", 5000, "");
+    bench_alias("alias-expansion", aliased);
+    bench_alias("alias-repeated", repeated);
+    bench_alias("alias-none", corpus[1].line);
+
+    // the expansion cost should not depend on the nb of defined aliases
+    char key[32];
+    for (i = 0; i < BENCH_NB_ALIASES; i++) {
+        snprintf(key, sizeof(key), "alias%zu", i);
+        alias(key, "echo generated");
+    }
+    bench_alias("alias-repeated-5000", repeated);
+
+    for (i = 0; i < nb; i++)
+        free(corpus[i].line);
+    free(aliased);
+    free(repeated);
+    return EXIT_SUCCESS;
+}
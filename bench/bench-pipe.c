@@ -0,0 +1,112 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * ----------------------------------------------------------------------
+ * bench-pipe.c: pipeline throughput benchmark. Streams zeroes from 'head -c' through 2-,
+ *  4- and 8-stage pipelines of 'cat' commands via execute(), at growing pipe capacities
+ *  (set with PIPE_SIZE), and reports the MB/s. Build and run with 'make bench-pipe'; pass
+ *  the nb of MiB to stream per run as the first argument (default 256).
+ * ----------------------------------------------------------------------
+ */
+
+#include "../jsh-parse.h"
+#include <time.h>
+
+#define BENCH_DEFAULT_MIB       256     // default nb of MiB streamed through every pipeline
+#define BENCH_MAX_STAGES        8
+
+// ########## stubs for the jsh.c globals the parser links against ##########
+bool DEBUG = false;
+bool COLOR = false;
+bool I_AM_FORK = false;
+bool IS_INTERACTIVE = false;
+bool WAITING_FOR_CHILD = false;
+
+int is_built_in(comd *comd) {
+    return -1;
+}
+
+int parse_built_in(comd *comd, int index) {
+    return EXIT_FAILURE;
+}
+
+struct stage_result;
+int execute(comd*, int, struct stage_result*);
+
+// ########## benchmark driver ##########
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * bench_pipe: streams mib MiB through a pipeline of the provided nb of stages; returns the MB/s
+ */
+double bench_pipe(int stages, int mib) {
+    char bytes[32];
+    char *head[] = {"head", "-c", bytes, "/dev/zero", NULL};
+    char *cat[] = {"cat", NULL};
+    comd cmds[BENCH_MAX_STAGES];
+    int i;
+
+    snprintf(bytes, sizeof(bytes), "%dM", mib);
+    cmds[0] = (comd) {head, 4, NULL, NULL, NULL, 0, NULL};
+    for (i = 1; i < stages; i++) {
+        cmds[i] = (comd) {cat, 1, NULL, NULL, NULL, 0, NULL};
+        cmds[i-1].next = &cmds[i];
+    }
+    cmds[stages-1].outf = "/dev/null";
+
+    double start = now();
+    if (execute(cmds, stages - 1, NULL) != EXIT_SUCCESS) {
+        printf("executing the %d-stage pipeline failed\n", stages);
+        exit(EXIT_FAILURE);
+    }
+    return mib * 1.048576 / (now() - start);
+}
+
+int main(int argc, char **argv) {
+    int mib = (argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_MIB;
+    const char *sizes[] = {"0", "256k", "1m"};  // "0": the default capacity (64KiB on Linux)
+    int stages[] = {2, 4, 8};
+    size_t i, j, nb_sizes = sizeof(sizes) / sizeof(sizes[0]), nb_stages = sizeof(stages) / sizeof(stages[0]);
+
+    if (mib <= 0)
+        mib = BENCH_DEFAULT_MIB;
+    printf("streaming %d MiB per pipeline\n", mib);
+    printf("%-16s", "capacity (B)");
+    for (j = 0; j < nb_stages; j++)
+        printf(" %8d-stage", stages[j]);
+    printf("\n");
+    for (i = 0; i < nb_sizes; i++) {
+        if (set_pipe_size(sizes[i]) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        if (PIPE_SIZE)
+            printf("%-16d", PIPE_SIZE);
+        else
+            printf("%-16s", "default");
+        for (j = 0; j < nb_stages; j++) {
+            printf(" %9.0f MB/s", bench_pipe(stages[j], mib));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return EXIT_SUCCESS;
+}
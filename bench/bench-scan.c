@@ -0,0 +1,156 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * ----------------------------------------------------------------------
+ * bench-scan.c: special char scanner benchmark. Compares the scalar and SIMD implementations
+ *  of scan() on inputs with a varying density of special chars, and the resulting lexer
+ *  throughput on long command lines. Build and run with 'make bench-scan'.
+ * ----------------------------------------------------------------------
+ */
+
+#include "../jsh-lex.h"
+#include "../jsh-scan.h"
+#include <time.h>
+
+#define BENCH_MIN_TIME          0.25    // min nb of seconds to repeat each measurement for
+#define BENCH_MIN_ITERS         3       // min nb of repetitions of each measurement
+#define BENCH_INPUT_SIZE        (4 * 1024 * 1024)   // the size of the generated inputs
+
+// ########## stubs for the jsh.c globals the lexer links against ##########
+bool DEBUG = false;
+bool COLOR = false;
+bool IS_INTERACTIVE = false;
+
+// ########## input generation ##########
+/*
+ * generate: returns a newly malloced line of len chars: words of plain chars, separated by a
+ *  special char on average every 'run' chars
+ */
+char *generate(size_t len, int run) {
+    static const char plain[] = "abcdefghijklmnopqrstuvwxyz0123456789-_./=";
+    static const char special[] = " ;|&<>()";  // note: no quotes, so the lexer never reports them
+    char *rv = malloc(len + 1);
+    size_t i;
+    unsigned int seed = 42;
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        rv[i] = ((seed >> 16) % run == 0) ? special[(seed >> 8) % (sizeof(special) - 1)]
+            : plain[(seed >> 8) % (sizeof(plain) - 1)];
+    }
+    rv[len] = '\0';
+    return rv;
+}
+
+// ########## benchmark driver ##########
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * bench_scan: repeatedly finds all special chars in the provided input; returns the ns/byte
+ */
+double bench_scan(const struct scan_set *set, const char *s, size_t len, size_t *nb_hits) {
+    unsigned long iters = 0;
+    double start = now(), elapsed;
+    do {
+        size_t i = 0, hits = 0;
+        while ((i += scan(set, s + i, len - i)) < len) {
+            hits++;
+            i++;
+        }
+        *nb_hits = hits;
+        iters++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME || iters < BENCH_MIN_ITERS);
+    return elapsed * 1e9 / (iters * len);
+}
+
+/*
+ * bench_lex: repeatedly lexes the provided line; returns the ns/byte
+ */
+double bench_lex(const char *line, size_t len, struct arena *a, size_t *nb_tokens) {
+    unsigned long iters = 0;
+    double start = now(), elapsed;
+    do {
+        struct tokens ts;
+        arena_mark mark = arena_save(a);
+        lex(line, &ts, a);
+        *nb_tokens = ts.nb;
+        arena_release(a, mark);
+        iters++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME || iters < BENCH_MIN_ITERS);
+    return elapsed * 1e9 / (iters * len);
+}
+
+int main(int argc, char **argv) {
+    struct arena a = ARENA_INIT;
+    struct scan_set set;
+    int runs[] = {4, 16, 64, 1024};
+    size_t i, nb_runs = sizeof(runs) / sizeof(runs[0]);
+    int impl;
+
+    scan_set_init(&set, " \t\r\n;&|()<>\"\\");
+    printf("%-22s", "ns/byte");
+    for (impl = 0; impl < SCAN_NB_IMPLS; impl++)
+        printf(" %9s", scan_impl_name(impl));
+    printf("\n");
+
+    for (i = 0; i < nb_runs; i++) {
+        char *input = generate(BENCH_INPUT_SIZE, runs[i]), name[32];
+        size_t expected = 0, hits = 0;
+        snprintf(name, sizeof(name), "scan (1 in %d)", runs[i]);
+        printf("%-22s", name);
+        for (impl = 0; impl < SCAN_NB_IMPLS; impl++) {
+            if (!scan_use(impl)) {
+                printf(" %9s", "-");
+                continue;
+            }
+            double ns = bench_scan(&set, input, BENCH_INPUT_SIZE, &hits);
+            if (impl == SCAN_SCALAR)
+                expected = hits;
+            if (hits != expected) {
+                printf("\n%s: found %zu special chars instead of %zu\n", scan_impl_name(impl), hits, expected);
+                return EXIT_FAILURE;
+            }
+            printf(" %9.3f", ns);
+        }
+        printf("\n");
+
+        snprintf(name, sizeof(name), "lex (1 in %d)", runs[i]);
+        printf("%-22s", name);
+        for (impl = 0; impl < SCAN_NB_IMPLS; impl++) {
+            if (!scan_use(impl)) {
+                printf(" %9s", "-");
+                continue;
+            }
+            double ns = bench_lex(input, BENCH_INPUT_SIZE, &a, &hits);
+            if (impl == SCAN_SCALAR)
+                expected = hits;
+            if (hits != expected) {
+                printf("\n%s: lexed %zu tokens instead of %zu\n", scan_impl_name(impl), hits, expected);
+                return EXIT_FAILURE;
+            }
+            printf(" %9.3f", ns);
+        }
+        printf("\n");
+        free(input);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * bench-spawn.c: process creation benchmark. Runs '/bin/true' through execute() with the
+ *  fork() and the posix_spawn() paths, while the heap holds a growing amount of touched
+ *  memory, and reports the spawns/sec. The fork() cost grows with the size of the page
+ *  tables to copy; the spawn cost shouldn't. Build and run with 'make bench-spawn'.
+ * ----------------------------------------------------------------------
+ */
+
+#include "../jsh-parse.h"
+#include <time.h>
+
+#define BENCH_MIN_TIME          0.5     // min nb of seconds to repeat each measurement for
+#define BENCH_MIN_ITERS         10      // min nb of spawns per measurement
+
+// ########## stubs for the jsh.c globals the parser links against ##########
+bool DEBUG = false;
+bool COLOR = false;
+bool I_AM_FORK = false;
+bool IS_INTERACTIVE = false;
+bool WAITING_FOR_CHILD = false;
+
+int is_built_in(comd *comd) {
+    return -1;
+}
+
+int parse_built_in(comd *comd, int index) {
+    return EXIT_FAILURE;
+}
+
+struct stage_result;
+int execute(comd*, int, struct stage_result*);
+
+// ########## benchmark driver ##########
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * bench_spawn: repeatedly executes the provided comd; returns the nb of executions per second
+ */
+double bench_spawn(comd *cmd) {
+    unsigned long iters = 0;
+    double start = now(), elapsed;
+    do {
+        if (execute(cmd, 0, NULL) != EXIT_SUCCESS) {
+            printf("executing '%s' failed\n", *cmd->cmd);
+            exit(EXIT_FAILURE);
+        }
+        iters++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME || iters < BENCH_MIN_ITERS);
+    return iters / elapsed;
+}
+
+int main(int argc, char **argv) {
+    char *args[] = {"/bin/true", NULL};
+    comd cmd = {args, 1, NULL, NULL, NULL, 0, NULL};
+    size_t heaps[] = {0, 64, 256, 1024};    // MiB of touched heap memory
+    size_t i, nb = sizeof(heaps) / sizeof(heaps[0]);
+
+    printf("%-12s %12s %12s %9s\n", "heap (MiB)", "fork/sec", "spawn/sec", "speedup");
+    for (i = 0; i < nb; i++) {
+        // touch every page, so it's mapped in the page tables fork() has to copy
+        char *heap = malloc(heaps[i] << 20);
+        if (heaps[i] && !heap) {
+            printf("%-12zu out of memory\n", heaps[i]);
+            break;
+        }
+        memset(heap, 1, heaps[i] << 20);
+
+        USE_SPAWN = false;
+        double forks = bench_spawn(&cmd);
+        USE_SPAWN = true;
+        double spawns = bench_spawn(&cmd);
+        printf("%-12zu %12.0f %12.0f %8.1fx\n", heaps[i], forks, spawns, spawns / forks);
+        free(heap);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * jsh-arena.c: a bump allocator for state that lives exactly as long as the evaluation of a
+ *  command line (tokens, syntax tree, argv arrays, comd structs and redirection targets).
+ *  Allocating is a pointer increment and releasing a whole line is a single assignment,
+ *  so a line needs no individual free()s and can't leak any of it.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-arena.h"
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE        (64 * 1024)     // the minimum size of a malloced chunk
+#define ARENA_ALIGN             (sizeof(max_align_t))
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;                // the size of data[]
+    size_t offset;              // the used part of data[]
+    max_align_t data[];
+};
+
+// #################### helper function definitions ####################
+struct arena_chunk *new_chunk(struct arena*, size_t);
+
+#define ALIGN_UP(n)     (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define CHUNK_TOP(c)    ((char*) (c)->data + (c)->offset)
+
+/*
+ * arena_alloc: returns a pointer to size bytes of aligned memory from the provided arena
+ */
+void *arena_alloc(struct arena *a, size_t size) {
+    size = ALIGN_UP(size ? size : 1);
+    struct arena_chunk *c = a->cur;
+    if (!c || c->offset + size > c->size) {
+        // move on to the next (released) chunk iff it's large enough, else insert a new one
+        if (c && c->next && c->next->size >= size) {
+            c = c->next;
+            c->offset = 0;
+        }
+        else {
+            struct arena_chunk *new = new_chunk(a, size);
+            if (c) {
+                new->next = c->next;
+                c->next = new;
+            }
+            else {
+                new->next = a->head;
+                a->head = new;
+            }
+            c = new;
+        }
+        a->cur = c;
+    }
+    void *rv = CHUNK_TOP(c);
+    c->offset += size;
+    a->used += size;
+    a->nb_allocs++;
+    if (a->used > a->high_water)
+        a->high_water = a->used;
+    return rv;
+}
+
+/*
+ * arena_calloc: arena_alloc() returning zeroed memory
+ */
+void *arena_calloc(struct arena *a, size_t size) {
+    return memset(arena_alloc(a, size), 0, size);
+}
+
+/*
+ * arena_grow: grows the provided arena memory, in place iff it's the most recent allocation
+ */
+void *arena_grow(struct arena *a, void *ptr, size_t oldsize, size_t newsize) {
+    struct arena_chunk *c = a->cur;
+    size_t old = ALIGN_UP(oldsize), new = ALIGN_UP(newsize);
+    if (ptr && c && (char*) ptr + old == CHUNK_TOP(c) && c->offset - old + new <= c->size) {
+        c->offset += new - old;
+        a->used += new - old;
+        if (a->used > a->high_water)
+            a->high_water = a->used;
+        return ptr;
+    }
+    void *rv = arena_alloc(a, newsize);
+    if (ptr)
+        memcpy(rv, ptr, oldsize);
+    return rv;
+}
+
+/*
+ * arena_strdup: returns an arena copy of the provided string
+ */
+char *arena_strdup(struct arena *a, const char *s) {
+    size_t len = strlen(s) + 1;
+    return memcpy(arena_alloc(a, len), s, len);
+}
+
+/*
+ * arena_save: returns a mark for the current position in the provided arena
+ */
+arena_mark arena_save(struct arena *a) {
+    return (arena_mark) {a->cur, a->cur ? a->cur->offset : 0, a->used};
+}
+
+/*
+ * arena_release: frees all memory allocated since the provided mark was saved
+ */
+void arena_release(struct arena *a, arena_mark mark) {
+    a->cur = mark.chunk ? mark.chunk : a->head;
+    if (a->cur)
+        a->cur->offset = mark.chunk ? mark.offset : 0;
+    a->used = mark.used;
+    if (a->used == 0)
+        a->nb_allocs = 0;
+}
+
+/*
+ * arena_reset: frees all memory allocated in the arena, keeping the chunks
+ */
+void arena_reset(struct arena *a) {
+    arena_release(a, (arena_mark) {NULL, 0, 0});
+}
+
+/*
+ * arena_free: frees all chunks of the provided arena
+ */
+void arena_free(struct arena *a) {
+    struct arena_chunk *c, *next;
+    for (c = a->head; c; c = next) {
+        next = c->next;
+        free(c);
+    }
+    *a = (struct arena) {.chunk_size = a->chunk_size};
+}
+
+/*
+ * new_chunk: returns a newly malloced chunk with room for at least size bytes, accounted to
+ *  the provided arena
+ */
+struct arena_chunk *new_chunk(struct arena *a, size_t size) {
+    size_t min = a->chunk_size ? ALIGN_UP(a->chunk_size) : ARENA_CHUNK_SIZE;
+    size_t data_size = (size > min) ? size : min;
+    struct arena_chunk *c = malloc(sizeof(struct arena_chunk) + data_size);
+    if (!c) {
+        printerrno("arena: running out of memory. Exiting");
+        exit(EXIT_FAILURE);
+    }
+    c->next = NULL;
+    c->size = data_size;
+    c->offset = 0;
+    a->nb_chunks++;
+    a->reserved += sizeof(struct arena_chunk) + data_size;
+    return c;
+}
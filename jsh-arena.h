@@ -0,0 +1,101 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_ARENA_H_INCLUDED
+#define JSH_ARENA_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+struct arena_chunk;
+
+/*
+ * a bump allocator: memory is handed out linearly from a list of large chunks and is only
+ *  given back all at once, by releasing the arena up to a previously saved mark
+ */
+struct arena {
+    struct arena_chunk *head;   // the first chunk of the list
+    struct arena_chunk *cur;    // the chunk allocations are currently served from
+    size_t used;                // nb of bytes currently allocated
+    size_t nb_allocs;           // nb of allocations since the last release to an empty arena
+    size_t high_water;          // the maximum nb of bytes ever allocated at once
+    size_t nb_chunks;           // the nb of chunks malloced (only freed by arena_free; reused after a release)
+    size_t reserved;            // the nb of bytes malloced for all chunks
+    size_t chunk_size;          // the minimum size of a malloced chunk; 0 for the default
+};
+
+#define ARENA_INIT  {NULL, NULL, 0, 0, 0, 0, 0, 0}
+
+/*
+ * a position in an arena to release back to
+ */
+typedef struct arena_mark {
+    struct arena_chunk *chunk;
+    size_t offset;              // the used part of chunk
+    size_t used;
+} arena_mark;
+
+/*
+ * arena_alloc: returns a pointer to @param(size) bytes of suitably aligned memory from the
+ *  provided arena. The memory stays valid until the arena is released to a mark saved before
+ *  this call. Exits with an error message iff out of memory.
+ */
+void *arena_alloc(struct arena*, size_t size);
+
+/*
+ * arena_calloc: arena_alloc() returning zeroed memory
+ */
+void *arena_calloc(struct arena*, size_t size);
+
+/*
+ * arena_grow: returns a pointer to @param(newsize) bytes with the same first @param(oldsize)
+ *  bytes as the provided arena memory @param(ptr) (or NULL). Grows in place iff @param(ptr)
+ *  is the most recent allocation, so growing arrays by doubling takes amortized linear time.
+ */
+void *arena_grow(struct arena*, void *ptr, size_t oldsize, size_t newsize);
+
+/*
+ * arena_strdup: returns a copy of the provided '\0' terminated string, allocated in the arena
+ */
+char *arena_strdup(struct arena*, const char*);
+
+/*
+ * arena_save: returns a mark for the current position in the provided arena
+ */
+arena_mark arena_save(struct arena*);
+
+/*
+ * arena_release: frees all memory allocated in the provided arena since @param(mark) was
+ *  saved, in O(1). The chunks are kept for reuse by later allocations.
+ */
+void arena_release(struct arena*, arena_mark mark);
+
+/*
+ * arena_reset: frees all memory allocated in the provided arena, in O(1), as if it were released
+ *  to a mark saved while it was empty; e.g. when the marks were lost in a longjmp()
+ */
+void arena_reset(struct arena*);
+
+/*
+ * arena_free: frees all chunks of the provided arena and resets it to an empty arena with the
+ *  same chunk_size. All memory allocated in it becomes invalid.
+ */
+void arena_free(struct arena*);
+
+#endif // JSH_ARENA_H_INCLUDED
@@ -0,0 +1,273 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * ----------------------------------------------------------------------
+ * jsh-cache.c: an LRU cache from input lines to their alias-expanded syntax trees, so a line
+ *  that is repeated (history recall, loops in sourced files) skips alias expansion and
+ *  parsing. Every tree lives in an arena of its own, which is freed when the line is evicted.
+ *  Entries are keyed by the alias table generation as well: any alias or unalias drops them.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-cache.h"
+
+#define PARSE_CACHE_DEFAULT_SIZE    128     // default max nb of cached lines
+#define PARSE_CACHE_MAX_LINE        1024    // longer lines are parsed, but never cached
+#define CACHE_CHUNK_SIZE(len)       (4096 + 32 * (len))     // arena chunk size for a line of len chars
+
+int PARSE_CACHE_SIZE = PARSE_CACHE_DEFAULT_SIZE;
+
+struct cached_line {
+    char *line;                 // the key: the line before alias expansion
+    size_t hash;
+    ast *tree;                  // the syntax tree of the alias-expanded line
+    struct arena arena;         // holds the key and the tree
+    int pins;                   // the nb of cache_get()s not yet passed to cache_put()
+    bool cached;                // false iff evicted or never cached; freed when no longer pinned
+    struct cached_line *next;   // the next entry in the same bucket, or in the detached list
+    struct cached_line *newer;  // the neighbours in the LRU list
+    struct cached_line *older;
+};
+
+struct {
+    struct cached_line **buckets;
+    size_t nb_buckets;          // always a power of two
+    size_t nb_entries;
+    size_t bytes;               // the nb of bytes held by the cached entries
+    unsigned long generation;   // the alias table generation the entries were expanded with
+    struct cached_line *newest; // the LRU list: newest is the most recently used entry
+    struct cached_line *oldest;
+    struct cached_line *detached;   // the pinned entries that aren't (or no longer) cached
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long uncached;     // nb of lines that weren't cacheable
+    unsigned long evictions;
+    unsigned long invalidations;
+} cache = {NULL, 0, 0, 0, 0, NULL, NULL, NULL, 0, 0, 0, 0, 0};
+
+// #################### helper function definitions ####################
+struct cached_line *cache_lookup(const char*, size_t);
+void cache_insert(struct cached_line*);
+void cache_detach(struct cached_line*);
+void lru_unlink(struct cached_line*);
+void lru_push(struct cached_line*);
+void free_line(struct cached_line*);
+
+ast *cache_get(const char *line, struct cached_line **pin, bool *incomplete) {
+    // any alias change invalidates all cached expansions
+    if (cache.generation != alias_generation()) {
+        if (cache.nb_entries) {
+            printdebug("cache: alias table changed; dropping %zu lines", cache.nb_entries);
+            cache.invalidations++;
+        }
+        cache_flush();
+        cache.generation = alias_generation();
+    }
+
+    size_t len = strlen(line), hash = 0;
+    bool cacheable = (PARSE_CACHE_SIZE > 0 && len <= PARSE_CACHE_MAX_LINE);
+    struct cached_line *e;
+    if (cacheable && (e = cache_lookup(line, hash = hash_string(line)))) {
+        printdebug("cache: hit for '%s'", line);
+        cache.hits++;
+        lru_unlink(e);
+        lru_push(e);
+        e->pins++;
+        *pin = e;
+        return e->tree;
+    }
+
+    // expand and parse the line in an arena of its own, sized to hold it in a single chunk
+    if (!(e = calloc(1, sizeof(struct cached_line)))) {
+        printerrno("cache: calloc");
+        exit(EXIT_FAILURE);
+    }
+    e->arena.chunk_size = CACHE_CHUNK_SIZE(len);
+    char *resolved = resolvealiases((char*) line);
+    e->tree = parse(resolved, &e->arena, incomplete);
+    free(resolved);
+    if (!e->tree) {
+        free_line(e);
+        return NULL;
+    }
+    e->pins = 1;
+    e->hash = hash;
+    *pin = e;
+
+    // a line with unbalanced quotes isn't cached, so the error is reported every time
+    if (cacheable && !e->tree->tokens.unbalanced) {
+        cache.misses++;
+        e->line = arena_strdup(&e->arena, line);
+        cache_insert(e);
+    }
+    else {
+        cache.uncached++;
+        e->next = cache.detached;
+        cache.detached = e;
+    }
+    return e->tree;
+}
+
+void cache_put(struct cached_line *e) {
+    if (--e->pins > 0 || e->cached)
+        return;
+    struct cached_line **p;
+    for (p = &cache.detached; *p != e; p = &(*p)->next)
+        ;
+    *p = e->next;
+    free_line(e);
+}
+
+void cache_unpin_all(void) {
+    struct cached_line *e, *next;
+    for (e = cache.newest; e; e = e->older)
+        e->pins = 0;
+    for (e = cache.detached; e; e = next) {
+        next = e->next;
+        free_line(e);
+    }
+    cache.detached = NULL;
+}
+
+void cache_flush(void) {
+    while (cache.oldest)
+        cache_detach(cache.oldest);
+}
+
+int cache_set_size(const char *size) {
+    char *end;
+    long n = strtol(size, &end, 10);
+    if (end == size || *end != '\0' || n < 0 || n > INT_MAX) {
+        printerr("set: invalid parse cache size '%s'", size);
+        return EXIT_FAILURE;
+    }
+    cache_flush();
+    free(cache.buckets);
+    cache.buckets = NULL;
+    cache.nb_buckets = 0;
+    PARSE_CACHE_SIZE = n;
+    printdebug("setting PARSE_CACHE_SIZE to %d", PARSE_CACHE_SIZE);
+    return EXIT_SUCCESS;
+}
+
+void cache_print_stats(void) {
+    unsigned long lookups = cache.hits + cache.misses;
+    printf("parse cache: %zu/%d lines, %zu bytes\n", cache.nb_entries, PARSE_CACHE_SIZE, cache.bytes);
+    printf("%lu hits, %lu misses (hit rate %.1f%%), %lu uncacheable, %lu evictions, %lu invalidations\n",
+        cache.hits, cache.misses, lookups ? 100.0 * cache.hits / lookups : 0.0, cache.uncached,
+        cache.evictions, cache.invalidations);
+}
+
+/*
+ * cache_lookup: returns the cached entry for the provided line and its hash, or NULL iff none
+ */
+struct cached_line *cache_lookup(const char *line, size_t hash) {
+    struct cached_line *e;
+    if (!cache.buckets)
+        return NULL;
+    for (e = cache.buckets[hash & (cache.nb_buckets - 1)]; e; e = e->next)
+        if (e->hash == hash && strcmp(e->line, line) == 0)
+            return e;
+    return NULL;
+}
+
+/*
+ * cache_insert: adds the provided entry to the cache as the most recently used one, evicting
+ *  the least recently used entry iff the cache is full
+ */
+void cache_insert(struct cached_line *e) {
+    if (!cache.buckets) {
+        for (cache.nb_buckets = 1; cache.nb_buckets < 2 * (size_t) PARSE_CACHE_SIZE; cache.nb_buckets <<= 1)
+            ;
+        if (!(cache.buckets = calloc(cache.nb_buckets, sizeof(struct cached_line*)))) {
+            printerrno("cache: calloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (cache.nb_entries >= PARSE_CACHE_SIZE) {
+        printdebug("cache: evicting '%s'", cache.oldest->line);
+        cache.evictions++;
+        cache_detach(cache.oldest);
+    }
+
+    struct cached_line **b = &cache.buckets[e->hash & (cache.nb_buckets - 1)];
+    e->next = *b;
+    *b = e;
+    lru_push(e);
+    e->cached = true;
+    cache.nb_entries++;
+    cache.bytes += sizeof(struct cached_line) + e->arena.reserved;
+}
+
+/*
+ * cache_detach: removes the provided entry from the cache; it's freed right away iff it isn't
+ *  pinned, else by the last cache_put()
+ */
+void cache_detach(struct cached_line *e) {
+    struct cached_line **p;
+    for (p = &cache.buckets[e->hash & (cache.nb_buckets - 1)]; *p != e; p = &(*p)->next)
+        ;
+    *p = e->next;
+    lru_unlink(e);
+    e->cached = false;
+    cache.nb_entries--;
+    cache.bytes -= sizeof(struct cached_line) + e->arena.reserved;
+    if (e->pins > 0) {
+        e->next = cache.detached;
+        cache.detached = e;
+    }
+    else
+        free_line(e);
+}
+
+/*
+ * lru_unlink: removes the provided entry from the LRU list
+ */
+void lru_unlink(struct cached_line *e) {
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        cache.newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        cache.oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+/*
+ * lru_push: inserts the provided entry at the most recently used end of the LRU list
+ */
+void lru_push(struct cached_line *e) {
+    e->newer = NULL;
+    e->older = cache.newest;
+    if (cache.newest)
+        cache.newest->newer = e;
+    else
+        cache.oldest = e;
+    cache.newest = e;
+}
+
+/*
+ * free_line: frees the provided entry and its arena
+ */
+void free_line(struct cached_line *e) {
+    arena_free(&e->arena);
+    free(e);
+}
@@ -0,0 +1,70 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_CACHE_H_INCLUDED
+#define JSH_CACHE_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+#include "jsh-parse.h"
+
+extern int PARSE_CACHE_SIZE;        // the max nb of lines kept in the parse cache; 0 disables it
+
+struct cached_line;
+
+/*
+ * cache_get: returns the syntax tree of the provided line after alias expansion, or NULL after
+ *  printing an error message iff it doesn't parse. The tree is taken from an LRU cache keyed
+ *  by the line and the alias table generation, so a repeated line isn't alias-expanded and
+ *  parsed again until an alias is (un)defined; else it's parsed and added to the cache.
+ * @arg pin: will point to the cache entry holding the tree; the entry isn't freed (even when
+ *  evicted in the meantime) until it's passed to cache_put()
+ * @arg incomplete: see parse(); an incomplete line isn't cached
+ */
+ast *cache_get(const char *line, struct cached_line **pin, bool *incomplete);
+
+/*
+ * cache_put: releases a cache entry returned by cache_get(); its tree may be freed from now on
+ */
+void cache_put(struct cached_line*);
+
+/*
+ * cache_unpin_all: releases all cache entries; to be called when the evaluation of the trees
+ *  was interrupted by a longjmp() before they could be passed to cache_put()
+ */
+void cache_unpin_all(void);
+
+/*
+ * cache_flush: drops all cached lines, e.g. when a setting that affects parsing changed
+ */
+void cache_flush(void);
+
+/*
+ * cache_set_size: sets PARSE_CACHE_SIZE to the provided nb of lines ('0' disables the cache)
+ *  and drops all cached lines. returns EXIT_SUCCESS iff the size is a valid number
+ */
+int cache_set_size(const char*);
+
+/*
+ * cache_print_stats: prints the nb of cached lines, the bytes they hold and the hit, miss,
+ *  eviction and invalidation counters of the parse cache on stdout
+ */
+void cache_print_stats(void);
+
+#endif // JSH_CACHE_H_INCLUDED
@@ -17,7 +17,22 @@
  * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE     // splice() and copy_file_range() on Linux
 #include "jsh-common.h"
+#include <time.h>
+#ifdef __linux__
+    #include <sys/sendfile.h>
+    #define HAVE_SPLICE
+    #define HAVE_SENDFILE
+    #if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+        #define HAVE_COPY_FILE_RANGE
+    #endif
+#endif
+
+#define COPY_CHUNK_SIZE         (1024 * 1024)   // the max nb of bytes moved per in-kernel copy call
+#define COPY_BUF_SIZE           (128 * 1024)    // the buffer size of the read/write copy loop
+
+__thread bool IS_BACKGROUND_THREAD = false;
 
 #define SET_ERR_COLOR \
     if (IS_INTERACTIVE && COLOR) \
@@ -46,7 +61,7 @@ void printerrno(const char *format, ...) {
 
 // TODO mss int debuglevel / priority
 void printdebug(const char *format, ...) {
-    if (DEBUG) {
+    if (DEBUG && !IS_BACKGROUND_THREAD) {
         if (IS_INTERACTIVE && COLOR)
             textcolor(stdout, RESET, YELLOW);	
         
@@ -116,37 +131,185 @@ void parsefile(char *path, void (*fct)(char*), bool errmsg) {
 }
 
 /*
- * parsestream: reads the provided stream strm line per line, passing each line, 
- *  including '\n' to the provided function fct.
+ * parsestream: reads the provided stream strm line per line, passing each line (without the
+ *  '\n') to the provided function fct, followed by a call fct("\n") iff the line ended with one.
+ *  The stream is read in STREAM_CHUNK_SIZE blocks with read(); lines can be of any length.
  * @NOTE: if you pass a pointer to 'printf()' here, this may introduce format-string-
  *  vulnerabilities as the lines are passed verbatim to the function. If you want to use
  *  this function to print the content of a file line per line, pass a pointer to
  *  'puts_verbatim()' (defined in jsh-common.h) instead.
+ * @NOTE: the underlying file descriptor is read directly, bypassing any data already
+ *  buffered in strm
  */
 void parsestream(FILE *strm, char* name, void (*fct)(char*)) {
     printdebug("-------- now parsing stream '%s' --------", name);
-    
-    char line[MAX_FILE_LINE_LENGTH+1];
-    int c, i = 0, j = 1;   // i = index in line; j = line nb
-    
-    while ((c = fgetc(strm)) != EOF)
-         if (c == '\n') {
-            line[i] = '\0';
-            printdebug("%s: now parsing line %d: '%s'", name, j, line);
-            fct(line);
-            fct("\n");
-            i = 0;
-            j++;
-         }
-         else if (i < MAX_FILE_LINE_LENGTH)
-            line[i++] = c;
-         else {
-            printerr("%s: ignoring line %d exeeding the max line length: %d", name, j, MAX_FILE_LINE_LENGTH);
-            while ((c=fgetc(strm)) != '\n');
-            i = 0;
-            j++;
-         }
-    printdebug("-------- end of stream '%s' --------", name);    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int fd = fileno(strm);
+    size_t size = STREAM_CHUNK_SIZE;    // the size of buf, excluding room for a '\0'
+    size_t len = 0;                     // buf[0, len) holds the (partial) line not passed yet
+    size_t total = 0;                   // total nb of bytes read
+    int j = 1;                          // line nb
+    char *buf = malloc(size + 1);
+    ssize_t n;
+    if (!buf) {
+        printerrno("%s: malloc", name);
+        return;
+    }
+
+    #define PASS_LINE(line, newline) \
+        do { \
+            printdebug("%s: now parsing line %d: '%s'", name, j, line); \
+            fct(line); \
+            if (newline) \
+                fct("\n"); \
+            j++; \
+        } while (false)
+
+    while (true) {
+        n = read(fd, buf + len, size - len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (n == -1)
+                printerrno("%s: reading line %d failed", name, j);
+            break;
+        }
+        total += n;
+
+        // pass all complete lines in the buffer
+        char *cur = buf, *bufend = buf + len + n, *nl;
+        while ((nl = memchr(cur, '\n', bufend - cur)) != NULL) {
+            *nl = '\0';
+            PASS_LINE(cur, true);
+            cur = nl + 1;
+        }
+
+        // move the partial last line to the front; grow the buffer iff it's full
+        len = bufend - cur;
+        memmove(buf, cur, len);
+        if (len == size) {
+            char *new = realloc(buf, 2 * size + 1);
+            if (!new) {
+                printerrno("%s: line %d too long", name, j);
+                free(buf);
+                return;
+            }
+            buf = new;
+            size *= 2;
+        }
+    }
+    // a final line without '\n'
+    if (len > 0) {
+        buf[len] = '\0';
+        PASS_LINE(buf, false);
+    }
+    free(buf);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printdebug("-------- end of stream '%s': %d lines (%zu bytes) in %.3fs: %.0f lines/sec --------",
+        name, j - 1, total, secs, (secs > 0) ? (j - 1) / secs : 0.0);
+}
+
+/*
+ * copystream: copies everything from the provided in fd to the provided out fd, byte for byte,
+ *  and returns EXIT_SUCCESS iff all data was copied. The data is moved in the kernel iff
+ *  possible: with copy_file_range() between regular files, with splice() iff either end is a
+ *  pipe, and with sendfile() from a regular file; else with a read()/write() loop. A method the
+ *  fds don't support (e.g. an O_APPEND out file) falls back to the next one, continuing at the
+ *  current file offsets.
+ * @NOTE: as for parsestream(), data already buffered in a FILE stream on the in fd is bypassed;
+ *  flush any FILE stream on the out fd first
+ */
+int copystream(int in, int out, char *name) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) == -1 || fstat(out, &out_st) == -1) {
+        printerrno("%s: couldn't stat the input or output", name);
+        return EXIT_FAILURE;
+    }
+    bool in_reg = S_ISREG(in_st.st_mode), out_reg = S_ISREG(out_st.st_mode);
+    size_t total = 0;
+    const char *method = "read/write";
+    ssize_t n = -1;
+
+    // a failing in-kernel copy with one of these errors isn't supported for the fds: fall back
+    #define UNSUPPORTED(err) \
+        ((err) == EINVAL || (err) == ENOSYS || (err) == EXDEV || (err) == EBADF || (err) == EOPNOTSUPP)
+    #define COPY_LOOP(meth, call) \
+        do { \
+            method = meth; \
+            while ((n = (call)) > 0 || (n == -1 && errno == EINTR)) \
+                if (n > 0) \
+                    total += n; \
+            if (n == 0) \
+                goto done; \
+            if (!UNSUPPORTED(errno)) \
+                goto fail; \
+            printdebug("%s: %s unsupported after %zu bytes: %s", name, method, total, strerror(errno)); \
+        } while (false)
+
+#ifdef HAVE_COPY_FILE_RANGE
+    if (in_reg && out_reg)
+        COPY_LOOP("copy_file_range", copy_file_range(in, NULL, out, NULL, COPY_CHUNK_SIZE, 0));
+#endif
+#ifdef HAVE_SPLICE
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode))
+        COPY_LOOP("splice", splice(in, NULL, out, NULL, COPY_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE));
+#endif
+#ifdef HAVE_SENDFILE
+    if (in_reg)
+        COPY_LOOP("sendfile", sendfile(out, in, NULL, COPY_CHUNK_SIZE));
+#endif
+
+    // the portable fallback
+    method = "read/write";
+    char *buf = malloc(COPY_BUF_SIZE);
+    if (!buf) {
+        printerrno("%s: couldn't allocate the copy buffer", name);
+        return EXIT_FAILURE;
+    }
+    while ((n = read(in, buf, COPY_BUF_SIZE)) > 0 || (n == -1 && errno == EINTR)) {
+        ssize_t done = 0, w;
+        while (done < n) {
+            if ((w = write(out, buf + done, n - done)) == -1) {
+                if (errno == EINTR)
+                    continue;
+                free(buf);
+                goto fail;
+            }
+            done += w;
+        }
+        total += (n > 0) ? n : 0;
+    }
+    free(buf);
+    if (n == -1)
+        goto fail;
+
+done:
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printdebug("%s: copied %zu bytes with %s in %.3fs: %.0f MB/s", name, total, method, secs,
+        (secs > 0) ? total / secs / 1e6 : 0.0);
+    return EXIT_SUCCESS;
+
+fail:
+    printerrno("%s: copying failed after %zu bytes (%s)", name, total, method);
+    return EXIT_FAILURE;
+}
+
+/*
+ * hash_string: the FNV-1a hash of the provided string
+ */
+size_t hash_string(const char *s) {
+    size_t h = 14695981039346656037ULL;
+    for (; *s; s++)
+        h = (h ^ (unsigned char) *s) * 1099511628211ULL;
+    return h;
 }
 
 /*
@@ -37,7 +37,16 @@
 
 // ########## common macro definitions #########
 #define ASSERT                  true    // whether or not to include the assert statements in the pre-compilation phase
-#define MAX_FILE_LINE_LENGTH    200     // the max nb of chars per line in a file to parse
+#define STREAM_CHUNK_SIZE       (64 * 1024)  // the nb of bytes read at once when parsing a file
+
+// the nanosecond timestamps of a struct stat
+#ifdef __APPLE__
+    #define ST_MTIM(st)         ((st).st_mtimespec)
+    #define ST_CTIM(st)         ((st).st_ctimespec)
+#else
+    #define ST_MTIM(st)         ((st).st_mtim)
+    #define ST_CTIM(st)         ((st).st_ctim)
+#endif
 
 #define REDIRECT_STR(fd1, fd2) \
     if (dup2(fd1, fd2) < 0) { \
@@ -94,6 +103,7 @@ extern bool COLOR;
 extern bool I_AM_FORK;               // whether or not the current process is a fork, i.e. child process
 extern bool IS_INTERACTIVE;
 extern bool WAITING_FOR_CHILD;
+extern __thread bool IS_BACKGROUND_THREAD;  // debug output of background threads would garble the prompt
 
 // common function definitions
 void printerr(const char*, ...);
@@ -104,8 +114,10 @@ void textcolor(FILE*, int, int);
 
 void parsefile(char*, void (*f)(char*), bool);
 void parsestream(FILE*, char*, void (*f)(char*));
+int copystream(int, int, char*);
 
 int string_cmp(const void*, const void*);
+size_t hash_string(const char*);
 bool is_sorted(void*, size_t, size_t, int (*compar)(const void *, const void *));
 char *gethome();
 char *strclone(const char*);
@@ -147,21 +147,13 @@ char *jsh_cmd_generator(const char *text, int state) {
  * jsh_alias_generator: a readline generator that returns matches with jsh aliases.
  */
 char *jsh_alias_generator(const char *text, int state) {
-    static char **alias_keys = NULL;
-    static unsigned int nb_alias_keys;
+    // the matching keys are a contiguous range of the alias store's sorted key view
+    static size_t index, end;
     if (!state) {
-        char **ret;
-        if ((ret = get_all_alias_keys(&nb_alias_keys, true))) {
-            if (alias_keys) {
-                int i;
-                for (i = 0; i < nb_alias_keys; i++)
-                    free(alias_keys[i]);
-                free(alias_keys);
-            }
-            alias_keys = ret;
-        }
+        index = alias_prefix_range(text, &end);
+        end += index;
     }
-    COMPLETION_SKELETON(alias_keys, nb_alias_keys); 
+    return (index < end) ? strclone(alias_key(index++)) : NULL;
 }
 
 /*
@@ -172,18 +164,17 @@ char *jsh_built_in_generator(const char *text, int state) {
 }
 
 /*
- * jsh_external_cmd_generator: a readline generator that returns matches for non-jsh commands.
- *  TODO search $PATH at boot-time and save the directory content in an array...
+ * jsh_external_cmd_generator: a readline generator that returns matches with the executables
+ *  in the $PATH dirs.
  */
 char *jsh_external_cmd_generator(const char *text, int state) {
-    // hackhackhack: an array with some usefull commands
-    const char *widely_used_cmds[] = {"git", "cat", "grep", "ls", "exit", "sudo", "kill", \
-    "killall", "links", "find", "clear", "chmod", "echo", "make", "poweroff", "reboot", \
-    "pacman", "aptitude", "apt-cache", "apt-get", "man", "nano", "vi", "gcc", "jsh", "zsh", \
-    "bash"};
-    #define nb_widely_used_cmds (sizeof(widely_used_cmds)/sizeof(widely_used_cmds[0]))
-    
-    COMPLETION_SKELETON(widely_used_cmds, nb_widely_used_cmds);
+    // the matching names are a contiguous range of the sorted $PATH catalog
+    static size_t index, end;
+    if (!state) {
+        index = path_catalog_range(text, &end);
+        end += index;
+    }
+    return (index < end) ? strclone(path_catalog_name(index++)) : NULL;
 }
 
 /*
@@ -24,6 +24,7 @@
 #include "jsh-common.h"
 #include "jsh-parse.h"
 #include "alias.h"
+#include "jsh-path.h"
 #include <readline/readline.h>      // GNU readline: http://cnswww.cns.cwru.edu/php/chet/readline/rltop.html
 
 extern const char *built_ins[];
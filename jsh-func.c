@@ -0,0 +1,314 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * ----------------------------------------------------------------------
+ * jsh-func.c: shell functions, defined with 'name() { list ; }'. A function's body is parsed
+ *  once when it's defined, into an arena of its own, and every call evaluates that syntax tree
+ *  directly in jsh, with the call's args as positional parameters ($1, $@, ...). Unlike an
+ *  alias, the body isn't expanded and parsed again per use, and unlike a script, a call
+ *  doesn't fork.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-func.h"
+
+#define FUNC_INIT_BUCKETS       32      // initial nb of buckets; always a power of two
+#define MAX_CALL_DEPTH          1000    // the max nesting depth of function calls
+#define FUNC_CHUNK_SIZE(len)    (4096 + 32 * (len))     // arena chunk size for a body of len chars
+
+struct function {
+    char *name;
+    char *text;                 // the source text of the body, for func_print()
+    ast *body;                  // the parsed body
+    struct arena arena;         // holds the name, the text and the parsed body
+    int calls;                  // the nb of calls in progress
+    bool defined;               // false iff redefined or undefined; freed after the last call returns
+    struct function *next;      // the next function in the same bucket, or in the retired list
+};
+
+struct {
+    struct function **buckets;
+    size_t nb_buckets;
+    size_t nb_functions;
+    struct function *retired;   // the redefined or undefined functions with calls in progress
+} functions = {NULL, 0, 0, NULL};
+
+/*
+ * a function call in progress
+ */
+struct call_frame {
+    struct function *func;
+    char **argv;                // the positional parameters: argv[0] is the name
+    int argc;
+    struct call_frame *caller;
+};
+
+struct call_frame *current_call = NULL;
+int call_depth = 0;
+
+// #################### helper function definitions ####################
+struct function **func_slot(const char*);
+void func_retire(struct function**);
+void func_free(struct function*);
+void grow_func_buckets(void);
+const char *param(struct call_frame*, char, char*);
+char *expand_word(const char*, struct call_frame*);
+int func_cmp(const void*, const void*);
+
+int func_define(const char *name, const char *body) {
+    struct function *new = calloc(1, sizeof(struct function));
+    if (!new) {
+        printerrno("function: calloc");
+        return EXIT_FAILURE;
+    }
+    new->arena.chunk_size = FUNC_CHUNK_SIZE(strlen(body));
+    new->name = arena_strdup(&new->arena, name);
+    new->text = arena_strdup(&new->arena, body);
+    if (!(new->body = parse(new->text, &new->arena, NULL))) {
+        printerr("function: couldn't define '%s'", name);
+        func_free(new);
+        return EXIT_FAILURE;
+    }
+
+    struct function **slot = func_slot(name);
+    if (*slot)
+        func_retire(slot);
+    else if (++functions.nb_functions > functions.nb_buckets) {
+        grow_func_buckets();
+        slot = func_slot(name);
+    }
+    new->next = *slot;
+    *slot = new;
+    new->defined = true;
+    printdebug("function: defined '%s' in %zu bytes", name, new->arena.reserved);
+    return EXIT_SUCCESS;
+}
+
+int func_undefine(const char *name) {
+    struct function **slot = func_slot(name);
+    if (!*slot) {
+        printerr("unfunction: no such function: %s", name);
+        return EXIT_FAILURE;
+    }
+    func_retire(slot);
+    functions.nb_functions--;
+    return EXIT_SUCCESS;
+}
+
+struct function *func_lookup(const char *name) {
+    return functions.nb_buckets ? *func_slot(name) : NULL;
+}
+
+int func_call(struct function *f, comd *comd) {
+    if (call_depth >= MAX_CALL_DEPTH) {
+        printerr("%s: maximum function call depth (%d) exceeded", f->name, MAX_CALL_DEPTH);
+        return EXIT_FAILURE;
+    }
+    // the frame lives on the C stack: calls nest like the evaluations of their bodies
+    struct call_frame frame = {f, comd->cmd, comd->length, current_call};
+    current_call = &frame;
+    call_depth++;
+    f->calls++;
+
+    int rv = evaluate(f->body->root);
+
+    current_call = frame.caller;
+    call_depth--;
+    if (--f->calls == 0 && !f->defined) {
+        struct function **p;
+        for (p = &functions.retired; *p != f; p = &(*p)->next)
+            ;
+        *p = f->next;
+        func_free(f);
+    }
+    return rv;
+}
+
+char **func_expand(char **argv, int *argc, const bool *params) {
+    struct call_frame *c = current_call;
+    if (!c)
+        return argv;
+
+    // a sole '$@' or '$*' word becomes one word per arg
+    int i, j, n = 0, size = *argc;
+    for (i = 0; i < *argc; i++)
+        if (params[i] && (!strcmp(argv[i], "$@") || !strcmp(argv[i], "$*")))
+            size += c->argc - 1;
+    char **rv = arena_alloc(&line_arena, sizeof(char*) * (size + 1));
+    for (i = 0; i < *argc; i++)
+        if (!params[i])
+            rv[n++] = argv[i];
+        else if (!strcmp(argv[i], "$@") || !strcmp(argv[i], "$*"))
+            for (j = 1; j < c->argc; j++)
+                rv[n++] = c->argv[j];
+        else
+            rv[n++] = expand_word(argv[i], c);
+    // e.g. '$@' without args: the empty cmd
+    if (n == 0)
+        rv[n++] = "";
+    rv[n] = NULL;
+    *argc = n;
+    return rv;
+}
+
+void func_unwind(void) {
+    size_t i;
+    struct function *f, *next;
+    current_call = NULL;
+    call_depth = 0;
+    for (i = 0; i < functions.nb_buckets; i++)
+        for (f = functions.buckets[i]; f; f = f->next)
+            f->calls = 0;
+    for (f = functions.retired; f; f = next) {
+        next = f->next;
+        func_free(f);
+    }
+    functions.retired = NULL;
+}
+
+void func_print(void) {
+    struct function *sorted[functions.nb_functions + 1], *f;
+    size_t i, n = 0;
+    for (i = 0; i < functions.nb_buckets; i++)
+        for (f = functions.buckets[i]; f; f = f->next)
+            sorted[n++] = f;
+    qsort(sorted, n, sizeof(struct function*), func_cmp);
+    for (i = 0; i < n; i++)
+        printf("%s() {%s}\n", sorted[i]->name, sorted[i]->text);
+}
+
+/*
+ * func_slot: returns a pointer to the link to the function with the provided name in its
+ *  bucket, or to the NULL link at the end of the bucket iff there is none
+ */
+struct function **func_slot(const char *name) {
+    if (!functions.buckets)
+        grow_func_buckets();
+    struct function **p = &functions.buckets[hash_string(name) & (functions.nb_buckets - 1)];
+    while (*p && strcmp((*p)->name, name) != 0)
+        p = &(*p)->next;
+    return p;
+}
+
+/*
+ * func_retire: unlinks the function the provided link points to from its bucket and frees it,
+ *  or iff it has calls in progress, moves it to the retired list until the last one returns
+ */
+void func_retire(struct function **slot) {
+    struct function *f = *slot;
+    *slot = f->next;
+    f->defined = false;
+    if (f->calls > 0) {
+        f->next = functions.retired;
+        functions.retired = f;
+    }
+    else
+        func_free(f);
+}
+
+/*
+ * func_free: frees the provided function and its arena
+ */
+void func_free(struct function *f) {
+    arena_free(&f->arena);
+    free(f);
+}
+
+/*
+ * grow_func_buckets: doubles the nb of buckets and rehashes all functions
+ */
+void grow_func_buckets(void) {
+    size_t nb = functions.nb_buckets ? 2 * functions.nb_buckets : FUNC_INIT_BUCKETS, i;
+    struct function **buckets = calloc(nb, sizeof(struct function*)), *f, *next;
+    if (!buckets) {
+        printerrno("function: calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < functions.nb_buckets; i++)
+        for (f = functions.buckets[i]; f; f = next) {
+            next = f->next;
+            f->next = buckets[hash_string(f->name) & (nb - 1)];
+            buckets[hash_string(f->name) & (nb - 1)] = f;
+        }
+    free(functions.buckets);
+    functions.buckets = buckets;
+    functions.nb_buckets = nb;
+}
+
+/*
+ * param: returns the value of the positional parameter $k of the provided call, or NULL iff
+ *  k doesn't name one. A parameter beyond the nb of args is the empty string.
+ * @arg buf: room for the value of '$#'
+ */
+const char *param(struct call_frame *c, char k, char *buf) {
+    if (k >= '0' && k <= '9')
+        return (k - '0' < c->argc) ? c->argv[k - '0'] : "";
+    if (k == '#') {
+        sprintf(buf, "%d", c->argc - 1);
+        return buf;
+    }
+    if (k == '@' || k == '*') {
+        // all args, separated by spaces
+        size_t len = 1;
+        int i;
+        for (i = 1; i < c->argc; i++)
+            len += strlen(c->argv[i]) + 1;
+        char *rv = arena_alloc(&line_arena, len), *out = rv;
+        *out = '\0';
+        for (i = 1; i < c->argc; i++)
+            out += sprintf(out, (i > 1) ? " %s" : "%s", c->argv[i]);
+        return rv;
+    }
+    return NULL;
+}
+
+/*
+ * expand_word: returns a copy of the provided word, allocated in the line_arena, with the
+ *  positional parameters of the provided call substituted
+ */
+char *expand_word(const char *word, struct call_frame *c) {
+    char buf[16];
+    const char *s, *v;
+    size_t len = 0;
+    for (s = word; *s; s++)
+        if (*s == '$' && (v = param(c, s[1], buf))) {
+            len += strlen(v);
+            s++;
+        }
+        else
+            len++;
+
+    char *rv = arena_alloc(&line_arena, len + 1), *out = rv;
+    for (s = word; *s; s++)
+        if (*s == '$' && (v = param(c, s[1], buf))) {
+            out = stpcpy(out, v);
+            s++;
+        }
+        else
+            *out++ = *s;
+    *out = '\0';
+    return rv;
+}
+
+/*
+ * func_cmp: compares two struct function pointers by name, for qsort()
+ */
+int func_cmp(const void *a, const void *b) {
+    return strcmp((*(struct function* const*) a)->name, (*(struct function* const*) b)->name);
+}
@@ -0,0 +1,73 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_FUNC_H_INCLUDED
+#define JSH_FUNC_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+#include "jsh-parse.h"
+
+struct function;
+
+/*
+ * func_define: defines (or redefines) a shell function with the provided name and body source
+ *  text. The body is parsed once, here; calls evaluate the parsed body directly.
+ *  returns EXIT_SUCCESS or EXIT_FAILURE after printing an error message iff it doesn't parse
+ */
+int func_define(const char *name, const char *body);
+
+/*
+ * func_undefine: removes the shell function with the provided name
+ *  returns EXIT_SUCCESS if it was found; else prints an error message and returns EXIT_FAILURE
+ */
+int func_undefine(const char *name);
+
+/*
+ * func_lookup: returns the shell function with the provided name, or NULL iff there is none
+ */
+struct function *func_lookup(const char *name);
+
+/*
+ * func_call: evaluates the body of the provided function in jsh itself, with the provided comd's
+ *  args as positional parameters: the name is $0, the args are $1 to $9, $# is their nb and
+ *  $@ or $* all of them. returns the exit status of the body
+ */
+int func_call(struct function*, comd*);
+
+/*
+ * func_expand: returns the provided argv array with the positional parameters of the function
+ *  call in progress substituted in the words flagged in params[], allocated in the line_arena;
+ *  a sole '$@' or '$*' word expands to one word per arg. Outside function calls, argv is
+ *  returned as is. @param(argc) is updated to the new length.
+ */
+char **func_expand(char **argv, int *argc, const bool *params);
+
+/*
+ * func_unwind: forgets all function calls in progress; to be called when their evaluation was
+ *  interrupted by a longjmp()
+ */
+void func_unwind(void);
+
+/*
+ * func_print: prints the definitions of all shell functions, sorted by name, on stdout
+ */
+void func_print(void);
+
+#endif // JSH_FUNC_H_INCLUDED
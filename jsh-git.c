@@ -0,0 +1,828 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * jsh-git.c: a minimal in-process git repository reader for the '%g' and '%c' prompt
+ *  expansion options. Instead of forking 'git' several times per prompt, the repository
+ *  files are read directly:
+ *
+ *  - the repository is found by walking up from the cwd, looking for a '.git' directory
+ *    or a '.git' file ("gitdir: path", as used by worktrees and submodules)
+ *  - the branch name is read from HEAD; a detached HEAD is resolved to a tag using the
+ *    loose refs/tags and packed-refs
+ *  - the dirty state is computed by comparing the stat() info of each work tree file with
+ *    its index entry; only files whose stat() info changed are hashed, like git does
+ *
+ *  All results are cached per repository and invalidated by the mtimes of the files
+ *  they were computed from.
+ *
+ *  Current limitations: sha256 repositories are not supported; gitlinks (submodules)
+ *  are never reported dirty and clean/smudge filters (e.g. core.autocrlf) are ignored.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-git.h"
+#include <stdint.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+
+#define GIT_MAX_CACHED_REPOS    8       // max nb of repositories kept in the cache
+#define GIT_SHA1_RAWSZ          20      // nb of bytes in a binary sha1 object name
+#define GIT_SHA1_HEXSZ          40      // nb of chars in a hex sha1 object name
+#define GIT_ABBREV_LEN          7       // nb of hex chars shown for a detached HEAD
+#define GIT_INDEX_HEADER_SIZE   12      // "DIRC" + version + nb of entries
+#define GIT_INDEX_ENTRY_SIZE    62      // fixed size part of an on-disk index entry
+#define GIT_HASH_BUF_SIZE       65536   // read chunk size when hashing work tree files
+
+// index entry flags (see git's Documentation/technical/index-format.txt)
+#define GIT_CE_VALID            0x8000  // "assume unchanged"
+#define GIT_CE_EXTENDED         0x4000
+#define GIT_CE_STAGEMASK        0x3000
+#define GIT_CE_SKIP_WORKTREE    0x4000  // extended flags
+#define GIT_CE_INTENT_TO_ADD    0x2000  // extended flags
+
+// git object modes as stored in the index
+#define GIT_MODE_REGULAR        0100644
+#define GIT_MODE_EXECUTABLE     0100755
+#define GIT_MODE_SYMLINK        0120000
+#define GIT_MODE_GITLINK        0160000
+
+#define TIMESPEC_EQ(a, b)       ((a).tv_sec == (b).tv_sec && (a).tv_nsec == (b).tv_nsec)
+
+/*
+ * a file stamp identifies a version of a file: the cached data computed from the file
+ *  is valid as long as the file's stamp doesn't change
+ */
+struct git_stamp {
+    struct timespec mtime;
+    struct timespec ctime;
+    ino_t ino;
+    off_t size;
+    bool exists;
+};
+
+struct git_entry {
+    size_t path;                // offset of the '\0' terminated path in repo->paths
+    uint32_t ctime;             // the 32 bit stat() info as recorded in the index
+    uint32_t mtime;
+    uint32_t ino;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t size;
+    uint32_t mode;
+    unsigned char sha1[GIT_SHA1_RAWSZ];
+    bool skip;                  // assume-valid, skip-worktree or gitlink: never checked
+    bool changed;               // unmerged or intent-to-add: always a change
+    bool verified;              // iff the content was hashed equal for stamp 'clean'
+    struct git_stamp clean;
+};
+
+struct git_repo {
+    char *workdir;              // top-level work tree dir or NULL for a bare git dir
+    char *gitdir;               // the git dir holding HEAD and the index
+    char *commondir;            // the git dir holding the refs (differs for worktrees)
+    bool sha256;
+
+    struct git_stamp head_stamp;    // cached branch name
+    struct git_stamp packed_stamp;
+    struct git_stamp tags_stamp;
+    char *branch;
+
+    int users;                      // nb of dirty checks using this repository
+
+    struct git_stamp index_stamp;   // cached parsed index
+    struct git_entry *entries;
+    size_t nb_entries;
+    char *paths;
+    bool index_valid;
+
+    struct git_repo *next;
+};
+
+typedef struct {
+    uint32_t h[5];
+    uint64_t len;
+    unsigned char buf[64];
+    size_t buflen;
+} sha1_ctx;
+
+// #################### helper function definitions ####################
+struct git_repo *git_find_repo(const char*);
+struct git_repo *git_create_repo(const char*, const char*);
+void git_free_repo(struct git_repo*);
+bool git_is_gitdir(const char*);
+char *git_read_file(const char*, size_t*);
+char *git_path(const char*, const char*);
+void git_stamp(const char*, struct git_stamp*, bool);
+bool git_stamp_eq(struct git_stamp*, struct git_stamp*);
+bool git_update_branch(struct git_repo*);
+char *git_find_tag(struct git_repo*, const char*);
+bool git_update_index(struct git_repo*);
+bool git_parse_index(struct git_repo*, const unsigned char*, size_t);
+bool git_entry_changed(struct git_repo*, struct git_entry*, const char*, struct stat*);
+bool git_hash_file(const char*, struct stat*, unsigned char*);
+void sha1_init(sha1_ctx*);
+void sha1_update(sha1_ctx*, const void*, size_t);
+void sha1_final(sha1_ctx*, unsigned char*);
+
+struct git_repo *repo_cache = NULL;     // MRU list of cached repositories
+
+/*
+ * The prompt's background worker computes the dirty state while the main thread reads the
+ *  branch name: cache_lock protects the repository list and branch names, index_lock
+ *  serializes the (slow) dirty checks so the main thread never waits for an index scan.
+ */
+pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * git_branch: writes the name of the checked out branch of the git repository containing
+ *  @param(cwd) in @param(buf), without forking any git process.
+ */
+bool git_branch(const char *cwd, char *buf, size_t len) {
+    pthread_mutex_lock(&cache_lock);
+    struct git_repo *repo = git_find_repo(cwd);
+    bool rv = repo && git_update_branch(repo);
+    if (rv)
+        snprintf(buf, len, "%s", repo->branch);
+    pthread_mutex_unlock(&cache_lock);
+    return rv;
+}
+
+/*
+ * git_is_dirty: returns 1 iff the work tree of the git repository containing @param(cwd)
+ *  has unstaged changes, 0 iff it is clean and -1 iff unknown.
+ */
+int git_is_dirty(const char *cwd) {
+    pthread_mutex_lock(&cache_lock);
+    struct git_repo *repo = git_find_repo(cwd);
+    if (repo)
+        repo->users++;  // protect the repository from being evicted
+    pthread_mutex_unlock(&cache_lock);
+
+    if (!repo)
+        return -1;
+
+    pthread_mutex_lock(&index_lock);
+    size_t i, prefix = strlen(repo->workdir ? repo->workdir : "") + 1;
+    char path[PATH_MAX];
+    int rv = 0;
+    if (!repo->workdir || repo->sha256 || prefix >= PATH_MAX || !git_update_index(repo))
+        rv = -1;
+    else
+        snprintf(path, PATH_MAX, "%s/", repo->workdir);
+
+    for (i = 0; rv == 0 && i < repo->nb_entries; i++) {
+        struct git_entry *e = &repo->entries[i];
+        struct stat st;
+        if (e->skip)
+            continue;
+
+        snprintf(path + prefix, PATH_MAX - prefix, "%s", repo->paths + e->path);
+        if (e->changed || lstat(path, &st) == -1 || git_entry_changed(repo, e, path, &st)) {
+            printdebug("git: '%s' has changed", repo->paths + e->path);
+            rv = 1;
+        }
+    }
+    pthread_mutex_unlock(&index_lock);
+
+    pthread_mutex_lock(&cache_lock);
+    repo->users--;
+    pthread_mutex_unlock(&cache_lock);
+    return rv;
+}
+
+/*
+ * git_find_repo: walks up from @param(cwd) to find the enclosing git repository. Returns
+ *  a pointer to the cached repository struct (created if needed) or NULL if none found.
+ * @note: the caller should hold the cache_lock
+ */
+struct git_repo *git_find_repo(const char *cwd) {
+    char dir[PATH_MAX], dotgit[PATH_MAX];
+    char *gitdir = NULL, *workdir = NULL;
+    struct stat st;
+
+    if (!cwd || snprintf(dir, PATH_MAX, "%s", cwd) >= PATH_MAX)
+        return NULL;
+
+    while (!gitdir) {
+        // a truncated path can't be probed: dir then has no '.git' within PATH_MAX
+        bool fits = snprintf(dotgit, PATH_MAX, "%s/.git", strcmp(dir, "/") ? dir : "") < PATH_MAX;
+        if (fits && stat(dotgit, &st) == 0 && S_ISDIR(st.st_mode) && git_is_gitdir(dotgit)) {
+            gitdir = strclone(dotgit);
+            workdir = strclone(dir);
+        }
+        else if (fits && stat(dotgit, &st) == 0 && S_ISREG(st.st_mode)) {
+            // "gitdir: <path>" file, used by worktrees and submodules
+            char *content = git_read_file(dotgit, NULL);
+            if (content && strncmp(content, "gitdir: ", 8) == 0) {
+                char *target = content + 8;
+                target[strcspn(target, "\r\n")] = '\0';
+                gitdir = (*target == '/') ? strclone(target) : concat(3, dir, "/", target);
+                workdir = strclone(dir);
+            }
+            free(content);
+        }
+        else if (git_is_gitdir(dir)) {
+            gitdir = strclone(dir);     // cwd is inside a bare repository or a '.git' dir
+        }
+        else {
+            // strip the last path component
+            char *slash = strrchr(dir, '/');
+            if (!slash || strcmp(dir, "/") == 0)
+                return NULL;
+            if (slash == dir)
+                slash[1] = '\0';
+            else
+                *slash = '\0';
+        }
+    }
+
+    // look the git dir up in the cache and move it to the front
+    struct git_repo *cur, *prev = NULL;
+    int nb = 0;
+    for (cur = repo_cache; cur; prev = cur, cur = cur->next, nb++)
+        if (strcmp(cur->gitdir, gitdir) == 0) {
+            if (prev) {
+                prev->next = cur->next;
+                cur->next = repo_cache;
+                repo_cache = cur;
+            }
+            free(gitdir);
+            free(workdir);
+            return cur;
+        }
+
+    // evict the least recently used repository not in use if the cache is full
+    struct git_repo *victim = NULL, *victim_prev = NULL;
+    if (nb >= GIT_MAX_CACHED_REPOS)
+        for (prev = NULL, cur = repo_cache; cur; prev = cur, cur = cur->next)
+            if (!cur->users) {
+                victim = cur;
+                victim_prev = prev;
+            }
+    if (victim) {
+        if (victim_prev)
+            victim_prev->next = victim->next;
+        else
+            repo_cache = victim->next;
+        git_free_repo(victim);
+    }
+
+    struct git_repo *repo = git_create_repo(gitdir, workdir);
+    free(gitdir);
+    free(workdir);
+    repo->next = repo_cache;
+    repo_cache = repo;
+    printdebug("git: caching repository '%s'", repo->gitdir);
+    return repo;
+}
+
+/*
+ * git_create_repo: returns a newly malloced git_repo struct for the given git and
+ *  work tree dirs; the provided strings are copied
+ */
+struct git_repo *git_create_repo(const char *gitdir, const char *workdir) {
+    struct git_repo *repo = calloc(1, sizeof(struct git_repo));
+    repo->gitdir = strclone(gitdir);
+    repo->workdir = workdir ? strclone(workdir) : NULL;
+
+    // worktrees share the refs of the main repository
+    char *path = git_path(gitdir, "commondir");
+    char *common = git_read_file(path, NULL);
+    free(path);
+    if (common) {
+        common[strcspn(common, "\r\n")] = '\0';
+        repo->commondir = (*common == '/') ? strclone(common) : concat(3, gitdir, "/", common);
+        free(common);
+    }
+    else
+        repo->commondir = strclone(gitdir);
+
+    // check for the 'extensions.objectformat = sha256' config option
+    path = git_path(repo->commondir, "config");
+    char *config = git_read_file(path, NULL);
+    free(path);
+    char *opt = config ? strstr(config, "objectformat") : NULL;
+    if (opt) {
+        opt += strlen("objectformat");
+        opt += strspn(opt, " \t=");
+        repo->sha256 = (strncmp(opt, "sha256", 6) == 0);
+    }
+    free(config);
+    return repo;
+}
+
+/*
+ * git_free_repo: free()s the provided git_repo and all its cached data
+ */
+void git_free_repo(struct git_repo *repo) {
+    free(repo->workdir);
+    free(repo->gitdir);
+    free(repo->commondir);
+    free(repo->branch);
+    free(repo->entries);
+    free(repo->paths);
+    free(repo);
+}
+
+/*
+ * git_is_gitdir: returns whether the provided directory looks like a git dir,
+ *  i.e. contains a HEAD file, an objects and a refs directory
+ */
+bool git_is_gitdir(const char *dir) {
+    struct stat st;
+    char path[PATH_MAX];
+
+    #define GITDIR_HAS(name, type) \
+        (snprintf(path, PATH_MAX, "%s/" name, dir) < PATH_MAX && \
+         stat(path, &st) == 0 && type(st.st_mode))
+
+    return GITDIR_HAS("HEAD", S_ISREG) && GITDIR_HAS("objects", S_ISDIR) &&
+        GITDIR_HAS("refs", S_ISDIR);
+}
+
+/*
+ * git_path: returns a newly malloced string "dir/name"
+ */
+char *git_path(const char *dir, const char *name) {
+    return concat(3, dir, "/", name);
+}
+
+/*
+ * git_read_file: returns a newly malloced '\0' terminated buffer with the content of the
+ *  file at @param(path) or NULL if it couldn't be read. If @param(len) is non-NULL, it
+ *  will contain the nb of bytes read.
+ */
+char *git_read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+
+    char *buf = malloc(st.st_size + 1);
+    size_t n = 0;
+    ssize_t rv;
+    while (n < st.st_size && (rv = read(fd, buf + n, st.st_size - n)) > 0)
+        n += rv;
+    close(fd);
+
+    buf[n] = '\0';
+    if (len) *len = n;
+    return buf;
+}
+
+/*
+ * git_stamp: fills in the stamp of the file at @param(path); a non-existing file gets
+ *  a zeroed stamp. If @param(nofollow) is true, symbolic links are not followed.
+ */
+void git_stamp(const char *path, struct git_stamp *stamp, bool nofollow) {
+    struct stat st;
+    memset(stamp, 0, sizeof(struct git_stamp));
+    if ((nofollow ? lstat(path, &st) : stat(path, &st)) == -1)
+        return;
+
+    stamp->mtime = ST_MTIM(st);
+    stamp->ctime = ST_CTIM(st);
+    stamp->ino = st.st_ino;
+    stamp->size = st.st_size;
+    stamp->exists = true;
+}
+
+/*
+ * git_stamp_eq: returns whether the two provided stamps identify the same file version
+ */
+bool git_stamp_eq(struct git_stamp *a, struct git_stamp *b) {
+    return a->exists == b->exists && TIMESPEC_EQ(a->mtime, b->mtime) &&
+        TIMESPEC_EQ(a->ctime, b->ctime) && a->ino == b->ino && a->size == b->size;
+}
+
+/*
+ * git_update_branch: (re-)reads the branch name of the provided repository iff
+ *  HEAD or the tags changed. Returns false iff HEAD couldn't be read.
+ */
+bool git_update_branch(struct git_repo *repo) {
+    struct git_stamp head, packed, tags;
+    char *path = git_path(repo->gitdir, "HEAD");
+    git_stamp(path, &head, false);
+    if (!head.exists) {
+        free(path);
+        return false;
+    }
+
+    char *packed_path = git_path(repo->commondir, "packed-refs");
+    char *tags_path = git_path(repo->commondir, "refs/tags");
+    git_stamp(packed_path, &packed, false);
+    git_stamp(tags_path, &tags, false);
+    free(packed_path);
+    free(tags_path);
+
+    if (repo->branch && git_stamp_eq(&head, &repo->head_stamp) &&
+        git_stamp_eq(&packed, &repo->packed_stamp) && git_stamp_eq(&tags, &repo->tags_stamp)) {
+        free(path);
+        return true;
+    }
+
+    char *content = git_read_file(path, NULL);
+    free(path);
+    if (!content)
+        return false;
+    content[strcspn(content, "\r\n")] = '\0';
+
+    free(repo->branch);
+    if (strncmp(content, "ref: ", 5) == 0) {
+        // symbolic ref: strip the ref namespace like 'git symbolic-ref --short' does
+        char *ref = content + 5;
+        if (strncmp(ref, "refs/heads/", 11) == 0)
+            ref += 11;
+        else if (strncmp(ref, "refs/", 5) == 0)
+            ref += 5;
+        repo->branch = strclone(ref);
+    }
+    else {
+        // detached HEAD: show the tag pointing to it if any; else the abbreviated sha
+        char *tag = git_find_tag(repo, content);
+        if (tag) {
+            repo->branch = concat(3, "(", tag, ")");
+            free(tag);
+        }
+        else {
+            content[GIT_ABBREV_LEN < strlen(content) ? GIT_ABBREV_LEN : strlen(content)] = '\0';
+            repo->branch = concat(3, "(", content, ")");
+        }
+    }
+    free(content);
+
+    repo->head_stamp = head;
+    repo->packed_stamp = packed;
+    repo->tags_stamp = tags;
+    printdebug("git: HEAD of '%s' resolved to '%s'", repo->gitdir, repo->branch);
+    return true;
+}
+
+/*
+ * git_find_tag: returns a newly malloced string with the name of a tag pointing to the
+ *  provided hex commit sha or NULL if none found. Loose tags take precedence over packed
+ *  ones; annotated loose tags are not peeled.
+ */
+char *git_find_tag(struct git_repo *repo, const char *sha) {
+    if (strlen(sha) != GIT_SHA1_HEXSZ)
+        return NULL;
+
+    // 1. loose tags in refs/tags
+    char *dir_path = git_path(repo->commondir, "refs/tags");
+    DIR *dir = opendir(dir_path);
+    struct dirent *ent;
+    char *rv = NULL;
+    while (dir && !rv && (ent = readdir(dir))) {
+        if (*ent->d_name == '.')
+            continue;
+        char *path = git_path(dir_path, ent->d_name);
+        char *content = git_read_file(path, NULL);
+        if (content && strncmp(content, sha, GIT_SHA1_HEXSZ) == 0)
+            rv = strclone(ent->d_name);
+        free(content);
+        free(path);
+    }
+    if (dir)
+        closedir(dir);
+    free(dir_path);
+    if (rv)
+        return rv;
+
+    // 2. packed-refs: "<sha> <refname>" lines, optionally followed by a "^<peeled sha>"
+    char *path = git_path(repo->commondir, "packed-refs");
+    char *content = git_read_file(path, NULL);
+    free(path);
+    char *line, *next, *last_ref = NULL;
+    for (line = content; line && *line && !rv; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        else
+            next = line + strlen(line);
+
+        if (*line == '^') {
+            if (last_ref && strncmp(line + 1, sha, GIT_SHA1_HEXSZ) == 0)
+                rv = strclone(last_ref);
+        }
+        else if (*line != '#' && strlen(line) > GIT_SHA1_HEXSZ + 1) {
+            char *ref = line + GIT_SHA1_HEXSZ + 1;
+            last_ref = (strncmp(ref, "refs/tags/", 10) == 0) ? ref + 10 : NULL;
+            if (last_ref && strncmp(line, sha, GIT_SHA1_HEXSZ) == 0)
+                rv = strclone(last_ref);
+        }
+    }
+    free(content);
+    return rv;
+}
+
+/*
+ * git_update_index: (re-)parses the index of the provided repository iff it changed.
+ *  returns false iff the index couldn't be parsed.
+ */
+bool git_update_index(struct git_repo *repo) {
+    struct git_stamp stamp;
+    char *path = git_path(repo->gitdir, "index");
+    git_stamp(path, &stamp, false);
+
+    if (repo->index_valid && git_stamp_eq(&stamp, &repo->index_stamp)) {
+        free(path);
+        return true;
+    }
+
+    free(repo->entries);
+    free(repo->paths);
+    repo->entries = NULL;
+    repo->paths = NULL;
+    repo->nb_entries = 0;
+    repo->index_stamp = stamp;
+    repo->index_valid = true;
+
+    if (stamp.exists) { // a repository without commits may not have an index yet
+        size_t len;
+        unsigned char *content = (unsigned char*) git_read_file(path, &len);
+        repo->index_valid = content && git_parse_index(repo, content, len);
+        free(content);
+        printdebug("git: parsed index '%s' with %zu entries", path, repo->nb_entries);
+    }
+    free(path);
+    return repo->index_valid;
+}
+
+/*
+ * git_parse_index: parses the provided index file content (version 2, 3 or 4) into the
+ *  entries array of the provided repository. Returns false on a malformed index.
+ */
+bool git_parse_index(struct git_repo *repo, const unsigned char *buf, size_t len) {
+    #define BE16(p)     ((uint32_t) (p)[0] << 8 | (p)[1])
+    #define BE32(p)     ((uint32_t) (p)[0] << 24 | (uint32_t) (p)[1] << 16 | \
+                         (uint32_t) (p)[2] << 8 | (p)[3])
+
+    if (len < GIT_INDEX_HEADER_SIZE || memcmp(buf, "DIRC", 4) != 0)
+        return false;
+    uint32_t version = BE32(buf + 4);
+    uint32_t nb = BE32(buf + 8);
+    if (version < 2 || version > 4 || nb > len / GIT_INDEX_ENTRY_SIZE)
+        return false;
+
+    const unsigned char *p = buf + GIT_INDEX_HEADER_SIZE, *end = buf + len;
+    size_t paths_len = 0, paths_size = len;     // the index is larger than all paths
+    size_t prev_path = 0, prev_len = 0, i;
+    repo->entries = calloc(nb ? nb : 1, sizeof(struct git_entry));
+    repo->paths = malloc(paths_size);
+
+    for (i = 0; i < nb; i++) {
+        struct git_entry *e = &repo->entries[i];
+        if (end - p < GIT_INDEX_ENTRY_SIZE)
+            return false;
+
+        e->ctime = BE32(p);
+        e->mtime = BE32(p + 8);
+        e->ino = BE32(p + 20);
+        e->mode = BE32(p + 24);
+        e->uid = BE32(p + 28);
+        e->gid = BE32(p + 32);
+        e->size = BE32(p + 36);
+        memcpy(e->sha1, p + 40, GIT_SHA1_RAWSZ);
+        uint32_t flags = BE16(p + 60), ext_flags = 0;
+        const unsigned char *name = p + GIT_INDEX_ENTRY_SIZE;
+        if ((flags & GIT_CE_EXTENDED) && version >= 3) {
+            if (end - name < 2)
+                return false;
+            ext_flags = BE16(name);
+            name += 2;
+        }
+
+        e->skip = (flags & GIT_CE_VALID) || (ext_flags & GIT_CE_SKIP_WORKTREE) ||
+            (e->mode & 0170000) == GIT_MODE_GITLINK;
+        e->changed = (flags & GIT_CE_STAGEMASK) || (ext_flags & GIT_CE_INTENT_TO_ADD);
+        e->path = paths_len;
+
+        if (version == 4) {
+            // prefix compressed path: varint nb of bytes to strip from the previous path
+            size_t strip = *name & 0x7f;
+            while (*name++ & 0x80) {
+                if (name >= end)
+                    return false;
+                strip = ((strip + 1) << 7) | (*name & 0x7f);
+            }
+            size_t suffix_len = strnlen((const char*) name, end - name);
+            if (strip > prev_len || name + suffix_len >= end)
+                return false;
+            size_t keep = prev_len - strip;
+            if (paths_len + keep + suffix_len + 1 > paths_size) {
+                paths_size = 2 * (paths_size + keep + suffix_len + 1);
+                repo->paths = realloc(repo->paths, paths_size);
+            }
+            memmove(repo->paths + paths_len, repo->paths + prev_path, keep);
+            memcpy(repo->paths + paths_len + keep, name, suffix_len + 1);
+            prev_len = keep + suffix_len;
+            p = name + suffix_len + 1;
+        }
+        else {
+            size_t name_len = strnlen((const char*) name, end - name);
+            if (name + name_len >= end)
+                return false;
+            memcpy(repo->paths + paths_len, name, name_len + 1);
+            prev_len = name_len;
+            // entries are padded with 1-8 '\0' bytes to a multiple of eight bytes
+            p += ((name - p) + name_len + 8) & ~7;
+        }
+        prev_path = paths_len;
+        paths_len += prev_len + 1;
+        repo->nb_entries++;
+    }
+    return true;
+}
+
+/*
+ * git_entry_changed: returns whether the work tree file at @param(path), with the given
+ *  lstat() info differs from its index entry @param(e).
+ */
+bool git_entry_changed(struct git_repo *repo, struct git_entry *e, const char *path,
+    struct stat *st) {
+    // 1. a changed file type or executable bit is always a change
+    uint32_t mode;
+    if (S_ISLNK(st->st_mode))
+        mode = GIT_MODE_SYMLINK;
+    else if (S_ISREG(st->st_mode))
+        mode = (st->st_mode & S_IXUSR) ? GIT_MODE_EXECUTABLE : GIT_MODE_REGULAR;
+    else
+        return true;
+    if (mode != e->mode)
+        return true;
+
+    // 2. stat() shortcut: unchanged stat info means an unchanged file, unless the file
+    //  was modified in the same second the index was written ("racy git")
+    bool racy = (e->mtime >= (uint32_t) repo->index_stamp.mtime.tv_sec);
+    if (!racy && e->mtime == (uint32_t) ST_MTIM(*st).tv_sec &&
+        e->ctime == (uint32_t) ST_CTIM(*st).tv_sec && e->ino == (uint32_t) st->st_ino &&
+        e->uid == (uint32_t) st->st_uid && e->gid == (uint32_t) st->st_gid &&
+        e->size == (uint32_t) st->st_size)
+        return false;
+
+    // 3. the content was already hashed equal for this version of the file
+    struct git_stamp stamp = {ST_MTIM(*st), ST_CTIM(*st), st->st_ino, st->st_size, true};
+    if (e->verified && git_stamp_eq(&stamp, &e->clean))
+        return false;
+    if (e->size != (uint32_t) st->st_size)
+        return true;
+
+    // 4. compare the content hash
+    unsigned char sha1[GIT_SHA1_RAWSZ];
+    if (!git_hash_file(path, st, sha1) || memcmp(sha1, e->sha1, GIT_SHA1_RAWSZ) != 0)
+        return true;
+
+    // only remember files that can't be modified anymore within their mtime second
+    e->verified = (stamp.mtime.tv_sec < time(NULL));
+    e->clean = stamp;
+    return false;
+}
+
+/*
+ * git_hash_file: computes the git blob object name of the work tree file at @param(path)
+ *  with the given lstat() info into @param(sha1). Returns false iff reading failed.
+ */
+bool git_hash_file(const char *path, struct stat *st, unsigned char *sha1) {
+    sha1_ctx ctx;
+    char header[64];
+    sha1_init(&ctx);
+    sha1_update(&ctx, header, snprintf(header, 64, "blob %lld", (long long) st->st_size) + 1);
+
+    if (S_ISLNK(st->st_mode)) {
+        char target[PATH_MAX];
+        ssize_t n = readlink(path, target, PATH_MAX);
+        if (n != st->st_size)
+            return false;
+        sha1_update(&ctx, target, n);
+    }
+    else {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        char *buf = malloc(GIT_HASH_BUF_SIZE);
+        ssize_t n;
+        off_t total = 0;
+        while ((n = read(fd, buf, GIT_HASH_BUF_SIZE)) > 0) {
+            sha1_update(&ctx, buf, n);
+            total += n;
+        }
+        free(buf);
+        close(fd);
+        if (n < 0 || total != st->st_size)
+            return false;
+    }
+    sha1_final(&ctx, sha1);
+    return true;
+}
+
+// #################### SHA-1 (FIPS 180-4) ####################
+
+#define ROL32(x, n)     (((x) << (n)) | ((x) >> (32 - (n))))
+
+/*
+ * sha1_block: processes a single 64 byte block
+ */
+static void sha1_block(uint32_t h[5], const unsigned char *p) {
+    uint32_t w[80], a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f, k, t;
+    int i;
+    for (i = 0; i < 16; i++)
+        w[i] = BE32(p + 4*i);
+    for (; i < 80; i++)
+        w[i] = ROL32(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    for (i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        }
+        else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        }
+        else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        }
+        else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        t = ROL32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL32(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+void sha1_init(sha1_ctx *ctx) {
+    static const uint32_t init[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    memcpy(ctx->h, init, sizeof(init));
+    ctx->len = 0;
+    ctx->buflen = 0;
+}
+
+void sha1_update(sha1_ctx *ctx, const void *data, size_t len) {
+    const unsigned char *p = data;
+    ctx->len += len;
+    if (ctx->buflen) {
+        size_t n = (64 - ctx->buflen < len) ? 64 - ctx->buflen : len;
+        memcpy(ctx->buf + ctx->buflen, p, n);
+        ctx->buflen += n;
+        p += n;
+        len -= n;
+        if (ctx->buflen < 64)
+            return;
+        sha1_block(ctx->h, ctx->buf);
+        ctx->buflen = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64)
+        sha1_block(ctx->h, p);
+    memcpy(ctx->buf, p, len);
+    ctx->buflen = len;
+}
+
+void sha1_final(sha1_ctx *ctx, unsigned char *out) {
+    uint64_t bits = ctx->len * 8;
+    unsigned char pad[128] = {0x80};
+    size_t padlen = (ctx->buflen < 56) ? 56 - ctx->buflen : 120 - ctx->buflen;
+    int i;
+    for (i = 0; i < 8; i++)
+        pad[padlen + i] = bits >> (56 - 8*i);
+    sha1_update(ctx, pad, padlen + 8);
+    for (i = 0; i < 5; i++) {
+        out[4*i] = ctx->h[i] >> 24;
+        out[4*i+1] = ctx->h[i] >> 16;
+        out[4*i+2] = ctx->h[i] >> 8;
+        out[4*i+3] = ctx->h[i];
+    }
+}
@@ -0,0 +1,49 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_GIT_H_INCLUDED
+#define JSH_GIT_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+/*
+ * git_branch: writes the name of the checked out branch of the git repository containing
+ *  @param(cwd) in @param(buf), without forking any git process.
+ * @arg cwd     : the directory to start looking for a '.git' directory from
+ * @arg buf     : a buffer to hold the '\0' terminated branch name
+ * @arg len     : the size of @param(buf); longer names are truncated
+ * @return: true iff @param(cwd) is inside a git repository; else false and @param(buf)
+ *  is left untouched.
+ * @note: a detached HEAD is written as "(tag)" when a tag points to it, else as
+ *  "(abbreviated_sha)".
+ */
+bool git_branch(const char *cwd, char *buf, size_t len);
+
+/*
+ * git_is_dirty: returns whether the work tree of the git repository containing @param(cwd)
+ *  has changes that are not in the index, i.e. iff 'git diff --exit-code' would fail.
+ * @return: 1 iff there are unstaged changes; 0 iff the work tree is clean; -1 iff
+ *  @param(cwd) isn't inside a git work tree or the index couldn't be read.
+ * @note: the parsed index and all content hashes are cached per repository and are
+ *  only recomputed when the stat() information of a file or the index changes.
+ */
+int git_is_dirty(const char *cwd);
+
+#endif // JSH_GIT_H_INCLUDED
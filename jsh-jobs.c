@@ -0,0 +1,398 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * ----------------------------------------------------------------------
+ * jsh-jobs.c: background jobs. A list item followed by '&' is evaluated in a forked subshell
+ *  and recorded in the job table. Jobs are reaped asynchronously: the SIGCHLD handler only
+ *  writes a byte to a self-pipe, and the main loop reaps the job pids (never any other
+ *  child, e.g. of the prompt worker) with non-blocking waitpid() calls when the pipe is
+ *  readable. Blocking waits poll() on the pipe, so a SIGCHLD can't be missed.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-jobs.h"
+#include "jsh-parse.h"
+#include <signal.h>
+#include <poll.h>
+
+#define JOBS_INIT_SIZE          8       // initial nb of jobs allocated in the job table
+
+enum job_state {JOB_RUNNING, JOB_STOPPED, JOB_DONE};
+
+struct job {
+    int id;                     // the job id, as in '%N'
+    pid_t pid;                  // the pid of the subshell
+    pid_t pgid;                 // the process group of the job or 0 iff it shares jsh's
+    char *text;                 // the source text of the list item
+    enum job_state state;
+    int status;                 // JOB_DONE only: the exit status
+    bool changed;               // whether or not the state changed since the last notification
+};
+
+struct {
+    struct job *jobs;           // in order of launching: the last one is the current job
+    size_t nb;
+    size_t size;
+    int pipe[2];                // the SIGCHLD self-pipe: read end, write end
+    bool foreign;               // in a pipeline subshell: the jobs are children of the parent jsh
+} table = {NULL, 0, 0, {-1, -1}, false};
+
+// #################### helper function definitions ####################
+void sigchld_handler(int);
+void reap(void);
+struct job *find_job(const char*, const char*);
+void remove_job(struct job*);
+void print_job(struct job*);
+void wait_for_sigchld(void);
+
+void jobs_init(void) {
+    int i;
+    if (pipe(table.pipe) < 0) {
+        printerrno("jobs: couldn't create the SIGCHLD pipe");
+        return;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(table.pipe[i], F_SETFL, O_NONBLOCK);
+        fcntl(table.pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+int jobs_launch(struct node *item) {
+    bool job_control = IS_INTERACTIVE;
+
+    // make room in the job table first: a job that can't be tracked isn't started
+    if (table.nb == table.size) {
+        size_t size = table.size ? 2 * table.size : JOBS_INIT_SIZE;
+        struct job *jobs = realloc(table.jobs, sizeof(struct job) * size);
+        if (!jobs) {
+            printerrno("jobs: couldn't grow the job table for '%s'", item->text);
+            return EXIT_FAILURE;
+        }
+        table.jobs = jobs;
+        table.size = size;
+    }
+
+    fflush(NULL);   // don't duplicate buffered output in the subshell
+    pid_t pid = fork();
+    if (pid == -1) {
+        printerrno("couldn't start background job '%s'", item->text);
+        return EXIT_FAILURE;
+    }
+    else if (pid == 0) {
+        // ######## subshell: forget the parent's jobs and evaluate the item ########
+        I_AM_FORK = true;
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        close(table.pipe[0]);
+        close(table.pipe[1]);
+        table.pipe[0] = table.pipe[1] = -1;
+        table.nb = 0;
+        if (job_control)
+            setpgid(0, 0);
+        else {
+            int fd = open("/dev/null", O_RDONLY);
+            if (fd >= 0) {
+                dup2(fd, STDIN_FILENO);
+                close(fd);
+            }
+        }
+        exit(evaluate(item));
+    }
+    // also set the process group in the parent, so it's set before any jobs_fg()
+    if (job_control)
+        setpgid(pid, pid);
+
+    struct job *j = &table.jobs[table.nb];
+    *j = (struct job) {table.nb ? table.jobs[table.nb-1].id + 1 : 1, pid, job_control ? pid : 0,
+        strclone(item->text), JOB_RUNNING, 0, false};
+    table.nb++;
+    printdebug("jobs: launched job %d with pid %d: '%s'", j->id, pid, j->text);
+    if (IS_INTERACTIVE)
+        printf("[%d] %d\n", j->id, pid);
+    return EXIT_SUCCESS;
+}
+
+void jobs_notify(void) {
+    size_t i;
+    reap();
+    for (i = 0; i < table.nb; i++) {
+        struct job *j = &table.jobs[i];
+        if (!j->changed)
+            continue;
+        print_job(j);
+        j->changed = false;
+        if (j->state == JOB_DONE)
+            remove_job(j--), i--;
+    }
+}
+
+void jobs_print(void) {
+    size_t i;
+    reap();
+    for (i = 0; i < table.nb; i++) {
+        struct job *j = &table.jobs[i];
+        print_job(j);
+        j->changed = false;
+        if (j->state == JOB_DONE)
+            remove_job(j--), i--;
+    }
+}
+
+void jobs_subshell(void) {
+    signal(SIGCHLD, SIG_DFL);
+    close(table.pipe[0]);
+    close(table.pipe[1]);
+    table.pipe[0] = table.pipe[1] = -1;
+    table.foreign = true;
+}
+
+int jobs_wait(const char *spec) {
+    if (table.foreign) {
+        // a subshell has no jobs of its own to wait for
+        if (!spec)
+            return EXIT_SUCCESS;
+        printerr("wait: job '%s' isn't a child of this subshell", spec);
+        return 127;
+    }
+    if (!spec) {
+        // wait for all running jobs; their status is discarded
+        size_t i;
+        while (true) {
+            reap();
+            for (i = 0; i < table.nb && table.jobs[i].state != JOB_RUNNING; i++)
+                ;
+            if (i == table.nb)
+                break;
+            wait_for_sigchld();
+        }
+        for (i = 0; i < table.nb; i++)
+            if (table.jobs[i].state == JOB_DONE)
+                remove_job(&table.jobs[i--]);
+        return EXIT_SUCCESS;
+    }
+
+    struct job *j = find_job("wait", spec);
+    if (!j)
+        return 127;
+    int id = j->id;
+    while (true) {
+        reap();
+        // note: reaping doesn't move jobs
+        if (j->state != JOB_RUNNING)
+            break;
+        wait_for_sigchld();
+    }
+    printdebug("jobs: waited for job %d", id);
+    if (j->state == JOB_STOPPED)
+        return 128 + SIGTSTP;
+    int status = j->status;
+    remove_job(j);
+    return status;
+}
+
+int jobs_fg(const char *spec) {
+    if (table.foreign) {
+        printerr("fg: no job control in a pipeline subshell");
+        return EXIT_FAILURE;
+    }
+    reap();
+    struct job *j = find_job("fg", spec);
+    if (!j)
+        return EXIT_FAILURE;
+    printf("%s\n", j->text);
+    fflush(stdout);
+
+    // hand the terminal to the job's process group and continue it
+    bool tty = j->pgid && isatty(STDIN_FILENO);
+    if (tty)
+        tcsetpgrp(STDIN_FILENO, j->pgid);
+    kill(j->pgid ? -j->pgid : j->pid, SIGCONT);
+    j->state = JOB_RUNNING;
+
+    int status = 0;
+    WAITING_FOR_CHILD = true;
+    while (waitpid(j->pid, &status, WUNTRACED) == -1 && errno == EINTR)
+        ;
+    WAITING_FOR_CHILD = false;
+
+    // take the terminal back; jsh isn't in the foreground process group, so ignore SIGTTOU
+    if (tty) {
+        void (*old)(int) = signal(SIGTTOU, SIG_IGN);
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+        signal(SIGTTOU, old);
+    }
+    if (WIFSTOPPED(status)) {
+        j->state = JOB_STOPPED;
+        printf("\n");
+        print_job(j);
+        return 128 + WSTOPSIG(status);
+    }
+    remove_job(j);
+    return WAIT_STATUS(status);
+}
+
+int jobs_bg(const char *spec) {
+    if (table.foreign) {
+        printerr("bg: no job control in a pipeline subshell");
+        return EXIT_FAILURE;
+    }
+    reap();
+    struct job *j = find_job("bg", spec);
+    if (!j)
+        return EXIT_FAILURE;
+    if (j->state == JOB_DONE) {
+        printerr("bg: job %d has terminated", j->id);
+        return EXIT_FAILURE;
+    }
+    kill(j->pgid ? -j->pgid : j->pid, SIGCONT);
+    j->state = JOB_RUNNING;
+    printf("[%d] %s &\n", j->id, j->text);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * sigchld_handler: wakes up the main loop; the children are reaped by reap()
+ */
+void sigchld_handler(int signo) {
+    int saved_errno = errno;
+    if (write(table.pipe[1], "", 1) < 0) {
+        // the pipe is full: the main loop will be woken up anyway
+    }
+    errno = saved_errno;
+}
+
+/*
+ * reap: drains the self-pipe and updates the state of all jobs, without blocking
+ */
+void reap(void) {
+    char buf[64];
+    size_t i;
+    int status;
+    if (table.foreign)
+        return;
+    while (table.pipe[0] != -1 && read(table.pipe[0], buf, sizeof(buf)) > 0)
+        ;
+    for (i = 0; i < table.nb; i++) {
+        struct job *j = &table.jobs[i];
+        if (j->state == JOB_DONE)
+            continue;
+        pid_t pid = waitpid(j->pid, &status, WNOHANG | WUNTRACED | WCONTINUED);
+        if (pid != j->pid)
+            continue;
+        // note: a continued job was continued by jsh itself; no need to report it
+        if (WIFCONTINUED(status)) {
+            j->state = JOB_RUNNING;
+            continue;
+        }
+        if (WIFSTOPPED(status))
+            j->state = JOB_STOPPED;
+        else {
+            j->state = JOB_DONE;
+            j->status = WAIT_STATUS(status);
+        }
+        j->changed = true;
+        printdebug("jobs: job %d changed state to %d", j->id, j->state);
+    }
+}
+
+/*
+ * find_job: returns the job identified by the provided spec: '%N' or 'N' for job N, a pid, or
+ *  '%%' or '%+' for the current job; or the current job iff spec is NULL. Prints an error
+ *  message for the provided built-in and returns NULL iff there is no such job.
+ */
+struct job *find_job(const char *builtin, const char *spec) {
+    size_t i;
+    if (!spec || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        if (table.nb == 0) {
+            printerr("%s: no current job", builtin);
+            return NULL;
+        }
+        return &table.jobs[table.nb-1];
+    }
+    char *end;
+    bool is_id = (*spec == '%');
+    long n = strtol(spec + is_id, &end, 10);
+    if (*end == '\0' && end != spec + is_id) {
+        // a plain number is a pid iff there is a job with that pid, else a job id
+        for (i = 0; i < table.nb && !is_id; i++)
+            if (table.jobs[i].pid == n)
+                return &table.jobs[i];
+        for (i = 0; i < table.nb; i++)
+            if (table.jobs[i].id == n)
+                return &table.jobs[i];
+    }
+    printerr("%s: no such job '%s'", builtin, spec);
+    return NULL;
+}
+
+/*
+ * remove_job: removes the provided job from the job table
+ */
+void remove_job(struct job *j) {
+    free(j->text);
+    memmove(j, j + 1, sizeof(struct job) * (table.jobs + table.nb - j - 1));
+    table.nb--;
+}
+
+/*
+ * print_job: prints a bash style status line for the provided job on stdout
+ */
+void print_job(struct job *j) {
+    char state[32];
+    if (j->state == JOB_RUNNING)
+        strcpy(state, "Running");
+    else if (j->state == JOB_STOPPED)
+        strcpy(state, "Stopped");
+    else if (j->status == EXIT_SUCCESS)
+        strcpy(state, "Done");
+    else
+        snprintf(state, sizeof(state), "Exit %d", j->status);
+    size_t i = j - table.jobs;
+    char current = (i + 1 == table.nb) ? '+' : (i + 2 == table.nb) ? '-' : ' ';
+    printf("[%d]%c  %-24s%s%s\n", j->id, current, state, j->text, (j->state == JOB_RUNNING) ? " &" : "");
+}
+
+int jobs_sigchld_fd(void) {
+    return table.pipe[0];
+}
+
+bool jobs_sigchld_wait(void) {
+    char buf[64];
+    if (table.pipe[0] == -1)
+        return false;
+    wait_for_sigchld();
+    while (read(table.pipe[0], buf, sizeof(buf)) > 0)
+        ;
+    return true;
+}
+
+/*
+ * wait_for_sigchld: blocks until the SIGCHLD handler wrote to the self-pipe
+ */
+void wait_for_sigchld(void) {
+    struct pollfd pfd = {table.pipe[0], POLLIN, 0};
+    while (poll(&pfd, 1, -1) == -1 && errno == EINTR)
+        ;
+}
@@ -0,0 +1,94 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_JOBS_H_INCLUDED
+#define JSH_JOBS_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+#define WAIT_STATUS(s)          (WIFEXITED(s) ? WEXITSTATUS(s) : WTERMSIG(s))   // as returned by execute()
+
+struct node;
+
+/*
+ * jobs_init: creates the SIGCHLD self-pipe and installs the SIGCHLD handler. Should be called
+ *  once at startup, before any background job is launched.
+ */
+void jobs_init(void);
+
+/*
+ * jobs_launch: evaluates the provided and-or list item in a forked subshell without waiting
+ *  for it, and adds it to the job table. In an interactive session the job gets its own
+ *  process group, so it can be moved to the foreground with jobs_fg(); else its stdin is
+ *  redirected from /dev/null. returns EXIT_SUCCESS iff the job was started
+ */
+int jobs_launch(struct node*);
+
+/*
+ * jobs_subshell: should be called in a forked pipeline stage that runs a built-in: the job
+ *  table is kept, so 'jobs' prints it, but the jobs are children of the parent jsh, so they
+ *  can't be reaped, waited for or continued from the subshell
+ */
+void jobs_subshell(void);
+
+/*
+ * jobs_notify: reaps the finished background jobs and reports the ones that finished or
+ *  stopped since the last notification. Should be called before displaying the prompt.
+ */
+void jobs_notify(void);
+
+/*
+ * jobs_print: prints the state of all jobs in the job table on stdout; finished jobs are
+ *  removed afterwards
+ */
+void jobs_print(void);
+
+/*
+ * jobs_wait: waits until the job identified by the provided job spec ('%N' for job N, or a
+ *  pid) finishes or stops, and returns its exit status. Waits for all jobs iff spec is NULL.
+ */
+int jobs_wait(const char *spec);
+
+/*
+ * jobs_fg: continues the job identified by the provided job spec (the current job iff NULL)
+ *  in the foreground and waits for it. returns its exit status
+ */
+int jobs_fg(const char *spec);
+
+/*
+ * jobs_bg: continues the stopped job identified by the provided job spec (the current job
+ *  iff NULL) in the background
+ */
+int jobs_bg(const char *spec);
+
+/*
+ * jobs_sigchld_wait: blocks until a SIGCHLD arrived since the previous call, so a foreground
+ *  pipeline can reap its children in any order. returns false without blocking iff there's no
+ *  SIGCHLD self-pipe (jobs_init() wasn't called, or in a subshell)
+ */
+bool jobs_sigchld_wait(void);
+
+/*
+ * jobs_sigchld_fd: returns the read end of the SIGCHLD self-pipe, to poll() it together with
+ *  other fds, or -1 iff there's none. Drain it with jobs_sigchld_wait() when it's readable.
+ */
+int jobs_sigchld_fd(void);
+
+#endif // JSH_JOBS_H_INCLUDED
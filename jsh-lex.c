@@ -0,0 +1,173 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * jsh-lex.c: the lexical scanner for command lines. The input is read exactly once from
+ *  left to right; every token records the source span it was read from, so the parser
+ *  can report errors in terms of the original input.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-lex.h"
+#include "jsh-scan.h"
+
+#define TOKENS_INIT_SIZE        16      // initial nb of tokens allocated per token stream
+#define WORD_SPECIAL_CHARS      " \t\r\n;&|()<>\"\\"     // the chars ending a run of plain chars in a word
+#define QUOTE_SPECIAL_CHARS     "\"\\"                 // idem, inside double quotes
+
+struct scan_set word_chars, quote_chars;
+bool scan_sets_initialized = false;
+
+// #################### helper function definitions ####################
+void add_token(struct tokens*, struct arena*, size_t*, enum token_type, char*, size_t, size_t, bool);
+
+/*
+ * lex: splits the provided line into a stream of tokens in a single pass
+ */
+void lex(const char *line, struct tokens *ts, struct arena *a) {
+    size_t len = strlen(line);
+    size_t size = TOKENS_INIT_SIZE;
+    size_t i = 0;
+
+    if (!scan_sets_initialized) {
+        scan_set_init(&word_chars, WORD_SPECIAL_CHARS);
+        scan_set_init(&quote_chars, QUOTE_SPECIAL_CHARS);
+        scan_sets_initialized = true;
+    }
+
+    // the unescaped word texts never exceed their source span, plus one '\0' per word
+    char *out = arena_alloc(a, 2 * len + 2);
+    ts->toks = arena_alloc(a, sizeof(struct token) * size);
+    ts->nb = 0;
+    ts->unbalanced = false;
+
+    while (i < len) {
+        size_t start = i;
+        switch (line[i]) {
+            case ' ':
+            case '\t':
+            case '\r':
+                i++;
+                continue;
+            case '\n':
+            case ';':
+                i++;
+                add_token(ts, a, &size, TOK_SEMI, NULL, start, i, false);
+                continue;
+            case '&':
+                i += (line[i+1] == '&') ? 2 : 1;
+                add_token(ts, a, &size, (i - start == 2) ? TOK_AND : TOK_AMP, NULL, start, i, false);
+                continue;
+            case '|':
+                i += (line[i+1] == '|') ? 2 : 1;
+                add_token(ts, a, &size, (i - start == 2) ? TOK_OR : TOK_PIPE, NULL, start, i, false);
+                continue;
+            case '(':
+                add_token(ts, a, &size, TOK_LPAREN, NULL, start, ++i, false);
+                continue;
+            case ')':
+                add_token(ts, a, &size, TOK_RPAREN, NULL, start, ++i, false);
+                continue;
+            case '<':
+                add_token(ts, a, &size, TOK_IN, NULL, start, ++i, false);
+                continue;
+            case '>':
+                i += (line[i+1] == '>') ? 2 : 1;
+                add_token(ts, a, &size, (i - start == 2) ? TOK_APPEND : TOK_OUT, NULL, start, i, false);
+                continue;
+            case '#':
+                // a comment runs up to the end of the line
+                while (i < len && line[i] != '\n')
+                    i++;
+                continue;
+            case '2':
+                if (line[i+1] == '>') {
+                    i += 2;
+                    add_token(ts, a, &size, TOK_ERR, NULL, start, i, false);
+                    continue;
+                }
+                break;
+        }
+
+        /**** a word: read up to the next unquoted blank or operator char ****/
+        char *word = out;
+        bool quoted = false, inquotes = false, done = false;
+        while (i < len && !done) {
+            // copy the run of plain chars up to the next special char at once
+            size_t n = scan(inquotes ? &quote_chars : &word_chars, line + i, len - i);
+            memcpy(out, line + i, n);
+            out += n;
+            i += n;
+            if (i == len)
+                break;
+
+            char c = line[i];
+            if (inquotes) {
+                if (c == '"')
+                    inquotes = false;
+                else if (c == '\\' && (line[i+1] == '"' || line[i+1] == '\\'))
+                    *out++ = line[++i];
+                else
+                    *out++ = c;
+                i++;
+                continue;
+            }
+            switch (c) {
+                case '"':
+                    inquotes = quoted = true;
+                    i++;
+                    break;
+                case '\\':
+                    if (i + 1 < len) {
+                        quoted = true;
+                        i++;
+                    }
+                    *out++ = line[i++];
+                    break;
+                default:
+                    // an unquoted blank or operator char
+                    done = true;
+            }
+        }
+        *out++ = '\0';
+        ts->unbalanced = inquotes;
+        add_token(ts, a, &size, TOK_WORD, word, start, i, quoted);
+    }
+    add_token(ts, a, &size, TOK_END, NULL, len, len, false);
+}
+
+/*
+ * add_token: appends a token to the provided token stream, growing it iff needed
+ */
+void add_token(struct tokens *ts, struct arena *a, size_t *size, enum token_type type, char *text,
+    size_t start, size_t end, bool quoted) {
+    if (ts->nb == *size) {
+        ts->toks = arena_grow(a, ts->toks, sizeof(struct token) * *size, sizeof(struct token) * 2 * *size);
+        *size *= 2;
+    }
+    ts->toks[ts->nb++] = (struct token) {type, text, start, end, quoted};
+}
+
+/*
+ * token_name: returns a human readable name for the provided token type
+ */
+const char *token_name(enum token_type type) {
+    static const char *names[] = {"word", ";", "&&", "||", "|", "&", "(", ")", "<", ">", ">>",
+        "2>", "end of line"};
+    return names[type];
+}
@@ -0,0 +1,74 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_LEX_H_INCLUDED
+#define JSH_LEX_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+#include "jsh-arena.h"
+
+enum token_type {
+    TOK_WORD,           // a (possibly quoted) word
+    TOK_SEMI,           // ';' or '\n'
+    TOK_AND,            // '&&'
+    TOK_OR,             // '||'
+    TOK_PIPE,           // '|'
+    TOK_AMP,            // '&'
+    TOK_LPAREN,         // '('
+    TOK_RPAREN,         // ')'
+    TOK_IN,             // '<'
+    TOK_OUT,            // '>'
+    TOK_APPEND,         // '>>'
+    TOK_ERR,            // '2>'
+    TOK_END             // end of input
+};
+
+struct token {
+    enum token_type type;
+    char *text;         // TOK_WORD only: the word with quotes and escapes removed; else NULL
+    size_t start;       // the source span line[start, end) the token was read from
+    size_t end;
+    bool quoted;        // TOK_WORD only: whether or not (a part of) the word was quoted or escaped
+};
+
+struct tokens {
+    struct token *toks; // the token stream, always terminated by a TOK_END token
+    size_t nb;          // the number of tokens, including the TOK_END token
+    bool unbalanced;    // whether or not the last word has an unbalanced '"'
+};
+
+/*
+ * lex: splits the provided '\0' terminated line into a stream of tokens in a single pass.
+ *  Words are delimited by unquoted blanks and operators; a '#' at the start of a word starts a
+ *  comment up to the end of the line. Outside quotes, '\' escapes the next char; inside double
+ *  quotes, it only escapes '"' and '\'.
+ * @arg ts: the token stream to initialize
+ * @arg a: the arena to allocate the tokens and word texts in
+ * @note: an unbalanced '"' is implicitly closed at the end of the line; it's up to the caller
+ *  to report it
+ */
+void lex(const char *line, struct tokens *ts, struct arena *a);
+
+/*
+ * token_name: returns a human readable name for the provided token type, e.g. for error messages
+ */
+const char *token_name(enum token_type);
+
+#endif // JSH_LEX_H_INCLUDED
@@ -0,0 +1,495 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * ----------------------------------------------------------------------
+ * jsh-parallel.c: the 'parallel' built-in, a native 'xargs -P'. A fixed pool of at most N
+ *  jobs is kept busy by packing the next batch of args and starting it with spawncmd()
+ *  (jsh-parse.c) as soon as a job is reaped; batches are small (one arg by default), so a
+ *  slow job doesn't hold up the others. The stdout of every job
+ *  is a pipe: all pipes and the SIGCHLD self-pipe (jsh-jobs.c) are poll()ed in a single loop,
+ *  so a job's output is never blocked by another one. The output of the oldest unfinished
+ *  job is streamed, the output of later jobs is buffered until it's their turn.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-parallel.h"
+#include "jsh-parse.h"
+#include "jsh-jobs.h"
+#include <signal.h>
+#include <poll.h>
+
+#define PARALLEL_ARG_HEADROOM   4096            // nb of bytes of ARG_MAX kept free for the cmd, as xargs does
+#define PARALLEL_CHUNK_SIZE     (16 * 1024)     // nb of bytes read at once from the stdout of a job
+#define PARALLEL_MAX_STATUS     101             // the returned status iff more than 100 jobs failed
+#define PARALLEL_USAGE          "usage: parallel [-j N] [-n N] [--tag] cmd [word...] [::: arg...]"
+
+extern char **environ;
+
+struct par_job {
+    char **argv;                // NULL-terminated: the cmd words and the args of the job's batch; freed once started
+    int argc;
+    char *tag;                  // --tag only: the args of the batch
+    pid_t pid;                  // the child process that is still to be reaped, or 0
+    int fd;                     // the read end of the job's stdout pipe, or -1 after EOF
+    int status;
+    char *buf;                  // the output that isn't written yet
+    size_t len;
+    size_t size;
+};
+
+struct runner {
+    struct par_job *jobs;       // the started jobs, in the order of the args
+    size_t nb;
+    size_t size;                // the allocated size of jobs (and of active)
+    size_t running;             // the nb of started jobs that aren't reaped yet
+    size_t next;                // the oldest job whose output isn't completely written
+    size_t *active;             // the started jobs that aren't reaped or at EOF yet
+    size_t nb_active;
+    char **words;               // the cmd words; a '{}' word is replaced by the batch's args
+    int nb_words;
+    int placeholder;            // the index of the '{}' word, or -1
+    char **args;
+    size_t nb_args;
+    size_t next_arg;            // args[next_arg, nb_args) aren't packed into a batch yet
+    size_t max_args;            // the max nb of args per batch
+    long limit;                 // the max nb of bytes of ARG_MAX the args of a batch may take
+    bool skipped;               // an arg was skipped because it's too long on its own
+    bool tag;
+    bool interrupted;           // a job was killed by ^C: don't start any further jobs
+};
+
+// #################### helper function definitions ####################
+char **read_args(size_t*);
+void init_batches(struct runner*);
+struct par_job *next_batch(struct runner*);
+void launch(struct runner*, int);
+void collect(struct runner*, struct par_job*);
+void reap_jobs(struct runner*, bool);
+void flush_lines(struct par_job*, bool);
+void advance(struct runner*);
+void append(struct par_job*, const char*, size_t);
+long env_size(void);
+
+int parallel(char **argv, int argc) {
+    long max_jobs = sysconf(_SC_NPROCESSORS_ONLN), max_args = 0, n;
+    struct runner r;
+    char *end, **args;
+    size_t nb_args, i;
+    int k = 1, cmd_start, cmd_end;
+    bool from_stdin;
+
+    memset(&r, 0, sizeof(r));
+    for (; k < argc && argv[k][0] == '-'; k++) {
+        if (strcmp(argv[k], "--tag") == 0) {
+            r.tag = true;
+            continue;
+        }
+        if ((strcmp(argv[k], "-j") == 0 || strcmp(argv[k], "-n") == 0) && k + 1 < argc) {
+            n = strtol(argv[k+1], &end, 10);
+            if (*end != '\0' || n <= 0) {
+                printerr("parallel: '%s' expects a positive number, not '%s'", argv[k], argv[k+1]);
+                return EXIT_FAILURE;
+            }
+            *((argv[k][1] == 'j') ? &max_jobs : &max_args) = n;
+            k++;
+            continue;
+        }
+        printerr("parallel: unrecognized option '%s'\n%s", argv[k], PARALLEL_USAGE);
+        return EXIT_FAILURE;
+    }
+    for (cmd_start = cmd_end = k; cmd_end < argc && strcmp(argv[cmd_end], ":::") != 0; cmd_end++)
+        ;
+    if (cmd_end == cmd_start) {
+        printerr("parallel: no command\n%s", PARALLEL_USAGE);
+        return EXIT_FAILURE;
+    }
+    if ((from_stdin = (cmd_end == argc)))
+        args = read_args(&nb_args);
+    else {
+        args = &argv[cmd_end+1];
+        nb_args = argc - cmd_end - 1;
+    }
+    if (max_jobs <= 0)
+        max_jobs = 1;
+    r.words = &argv[cmd_start];
+    r.nb_words = cmd_end - cmd_start;
+    r.args = args;
+    r.nb_args = nb_args;
+    r.max_args = max_args ? max_args : 1;
+    init_batches(&r);
+
+    // the jobs don't share jsh's stdin: it may hold the args, and they run concurrently
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    int sigfd = jobs_sigchld_fd();
+    struct pollfd *fds = NULL;
+    size_t *owner = NULL;       // the job of every polled pipe
+    size_t polled_size = 0;     // the allocated size of fds and owner
+
+    // ######## the job loop: start jobs, collect their output and reap them ########
+    WAITING_FOR_CHILD = true;   // ^C is for the jobs
+    while (true) {
+        while (r.running < (size_t) max_jobs && r.next_arg < r.nb_args && !r.interrupted)
+            launch(&r, devnull);
+        if (r.nb_active == 0)
+            break;
+        if (polled_size < r.nb_active + 1) {
+            polled_size = 2 * (r.nb_active + 1);
+            fds = realloc(fds, sizeof(struct pollfd) * polled_size);
+            owner = realloc(owner, sizeof(size_t) * polled_size);
+            if (!fds || !owner) {
+                printerrno("parallel: couldn't allocate the job table");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        size_t nfds = 0;
+        for (i = 0; i < r.nb_active; i++)
+            if (r.jobs[r.active[i]].fd != -1) {
+                owner[nfds] = r.active[i];
+                fds[nfds++] = (struct pollfd) {r.jobs[r.active[i]].fd, POLLIN, 0};
+            }
+        size_t npipes = nfds;
+        if (sigfd != -1)
+            fds[nfds++] = (struct pollfd) {sigfd, POLLIN, 0};
+        if (nfds > 0 && poll(fds, nfds, -1) == -1) {
+            if (errno != EINTR) {
+                printerrno("parallel: poll failed");
+                break;
+            }
+            nfds = npipes = 0;
+        }
+        for (i = 0; i < npipes; i++)
+            if (fds[i].revents)
+                collect(&r, &r.jobs[owner[i]]);
+        if (nfds > npipes && fds[npipes].revents)
+            jobs_sigchld_wait();    // doesn't block: only drains the self-pipe
+        reap_jobs(&r, sigfd == -1);
+        advance(&r);
+    }
+    WAITING_FOR_CHILD = false;
+    fflush(stdout);
+    printdebug("parallel: %zu args in %zu jobs, at most %ld at once", nb_args, r.nb, max_jobs);
+
+    // ######## aggregate the exit status and clean up ########
+    int status = r.skipped ? EXIT_FAILURE : EXIT_SUCCESS;
+    size_t failed = 0;
+    for (i = 0; i < r.nb; i++)
+        if (r.jobs[i].status != EXIT_SUCCESS)
+            failed++;
+    if (r.interrupted)
+        printerr("parallel: interrupted; %zu of %zu args not started", nb_args - r.next_arg, nb_args);
+    if (failed)
+        status = (failed > PARALLEL_MAX_STATUS - 1) ? PARALLEL_MAX_STATUS : (int) failed;
+    for (i = 0; i < r.nb; i++) {
+        free(r.jobs[i].tag);
+        free(r.jobs[i].buf);
+    }
+    free(r.jobs);
+    free(r.active);
+    free(owner);
+    free(fds);
+    if (devnull != -1)
+        close(devnull);
+    if (from_stdin) {
+        for (i = 0; i < nb_args; i++)
+            free(args[i]);
+        free(args);
+    }
+    return status;
+}
+
+/*
+ * read_args: returns a newly malloced array of the non-empty lines read from stdin, without
+ *  the trailing newline, and stores its length in nb
+ */
+char **read_args(size_t *nb) {
+    char **args = NULL, *line = NULL;
+    size_t size = 0, cap = 0;
+    ssize_t len;
+    *nb = 0;
+    while ((len = getline(&line, &cap, stdin)) != -1) {
+        if (len > 0 && line[len-1] == '\n')
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+        if (*nb == size) {
+            size = size ? 2 * size : 64;
+            char **new = realloc(args, sizeof(char*) * size);
+            if (!new) {
+                printerrno("parallel: couldn't allocate the args");
+                exit(EXIT_FAILURE);
+            }
+            args = new;
+        }
+        args[(*nb)++] = strclone(line);
+    }
+    free(line);
+    clearerr(stdin);
+    return args;
+}
+
+/*
+ * init_batches: computes the nb of bytes of ARG_MAX the args of a batch may take, besides the
+ *  cmd words and the environment, and finds the '{}' word, if any
+ */
+void init_batches(struct runner *r) {
+    long words_size = 0;
+    int k;
+    r->limit = sysconf(_SC_ARG_MAX);
+    if (r->limit <= 0)
+        r->limit = _POSIX_ARG_MAX;
+    r->placeholder = -1;
+    for (k = 0; k < r->nb_words; k++) {
+        words_size += strlen(r->words[k]) + 1 + sizeof(char*);
+        if (r->placeholder == -1 && strcmp(r->words[k], "{}") == 0)
+            r->placeholder = k;
+    }
+    r->limit -= env_size() + words_size + PARALLEL_ARG_HEADROOM;
+}
+
+/*
+ * next_batch: packs the next at most max_args args that fit in ARG_MAX into a new job at the
+ *  end of r->jobs and returns it, or returns NULL iff no args are left. An arg that's too
+ *  long on its own is skipped with an error message.
+ */
+struct par_job *next_batch(struct runner *r) {
+    size_t i = r->next_arg, j;
+    int k;
+    while (true) {
+        if (i == r->nb_args) {
+            r->next_arg = i;
+            return NULL;
+        }
+        // the next batch is args[i, j)
+        long bytes = 0;
+        for (j = i; j < r->nb_args && j - i < r->max_args; j++) {
+            long arg = strlen(r->args[j]) + 1 + sizeof(char*);
+            if (bytes + arg > r->limit)
+                break;
+            bytes += arg;
+        }
+        if (j > i)
+            break;
+        printerr("parallel: skipping an argument that's too long (%zu bytes)", strlen(r->args[i]));
+        r->skipped = true;
+        i++;
+    }
+    r->next_arg = j;
+
+    if (r->nb == r->size) {
+        size_t size = r->size ? 2 * r->size : 16;
+        struct par_job *new = realloc(r->jobs, sizeof(struct par_job) * size);
+        size_t *active = realloc(r->active, sizeof(size_t) * size);
+        if (new)
+            r->jobs = new;
+        if (active)
+            r->active = active;
+        if (!new || !active) {
+            printerrno("parallel: couldn't allocate the job table");
+            exit(EXIT_FAILURE);
+        }
+        r->size = size;
+    }
+    struct par_job *job = &r->jobs[r->nb++];
+    memset(job, 0, sizeof(struct par_job));
+    job->fd = -1;
+
+    // the batch's args replace the '{}' word, or are appended to the cmd
+    int nb_batch = j - i, nb_words = r->nb_words, placeholder = r->placeholder;
+    int pos = (placeholder == -1) ? nb_words : placeholder;
+    job->argc = nb_words + nb_batch - (placeholder != -1);
+    if (!(job->argv = malloc(sizeof(char*) * (job->argc + 1)))) {
+        printerrno("parallel: couldn't allocate the job table");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(job->argv, r->words, sizeof(char*) * pos);
+    memcpy(job->argv + pos, &r->args[i], sizeof(char*) * nb_batch);
+    memcpy(job->argv + pos + nb_batch, r->words + pos + (placeholder != -1),
+        sizeof(char*) * (job->argc - pos - nb_batch));
+    job->argv[job->argc] = NULL;
+    if (r->tag) {
+        job->tag = strclone(r->args[i]);
+        for (k = 1; k < nb_batch; k++) {
+            char *tag = concat(3, job->tag, " ", r->args[i+k]);
+            free(job->tag);
+            job->tag = tag;
+        }
+    }
+    return job;
+}
+
+/*
+ * launch: packs the next batch, if any, and starts it as a job with its stdout connected to
+ *  a new pipe
+ */
+void launch(struct runner *r, int devnull) {
+    struct par_job *job = next_batch(r);
+    int p[2], k;
+    if (!job)
+        return;
+    if (pipe(p) < 0) {
+        printerrno("parallel: couldn't create pipe");
+        exit(EXIT_FAILURE);
+    }
+    // no job may inherit the pipe of another job, or the reader never sees EOF
+    for (k = 0; k < 2; k++)
+        fcntl(p[k], F_SETFD, FD_CLOEXEC);
+
+    comd cmd = {job->argv, job->argc, NULL, NULL, NULL, 0, NULL};
+    job->pid = spawncmd(&cmd, devnull, p[1], NULL, 0);
+    close(p[1]);
+    free(job->argv);    // the args themselves are owned by the caller of parallel()
+    job->argv = NULL;
+    if (job->pid == -1) {
+        job->pid = 0;
+        job->status = EXIT_FAILURE;
+        close(p[0]);
+        return;
+    }
+    job->fd = p[0];
+    r->running++;
+    r->active[r->nb_active++] = job - r->jobs;
+}
+
+/*
+ * collect: reads the available output of the provided job: writes it directly iff the job
+ *  is the oldest unfinished one, else buffers it. Closes the pipe at EOF.
+ */
+void collect(struct runner *r, struct par_job *job) {
+    char chunk[PARALLEL_CHUNK_SIZE];
+    ssize_t n = read(job->fd, chunk, sizeof(chunk));
+    if (n == -1 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n <= 0) {
+        close(job->fd);
+        job->fd = -1;
+        if (r->tag)
+            flush_lines(job, true);
+        return;
+    }
+    if (!r->tag && job == &r->jobs[r->next]) {
+        fwrite(chunk, 1, n, stdout);
+        fflush(stdout);
+        return;
+    }
+    append(job, chunk, n);
+    if (r->tag)
+        flush_lines(job, false);
+}
+
+/*
+ * reap_jobs: reaps the jobs that finished and removes the jobs that are reaped and at EOF
+ *  from the active set
+ * @arg block: whether or not to block on the jobs at EOF (iff there are no SIGCHLD notifications)
+ */
+void reap_jobs(struct runner *r, bool block) {
+    size_t i;
+    int status;
+    pid_t pid;
+    for (i = 0; i < r->nb_active; i++) {
+        struct par_job *job = &r->jobs[r->active[i]];
+        if (job->pid > 0) {
+            int options = (block && job->fd == -1) ? 0 : WNOHANG;
+            while ((pid = waitpid(job->pid, &status, options)) == -1 && errno == EINTR)
+                ;
+            if (pid == job->pid || pid == -1) {
+                job->status = (pid == -1) ? EXIT_FAILURE : WAIT_STATUS(status);
+                if (pid != -1 && WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+                    r->interrupted = true;
+                printdebug("parallel: job %zu exited with %d", r->active[i], job->status);
+                job->pid = 0;
+                r->running--;
+            }
+        }
+        if (job->pid == 0 && job->fd == -1)
+            r->active[i--] = r->active[--r->nb_active];
+    }
+}
+
+/*
+ * flush_lines: --tag only: writes the complete lines in the output buffer of the provided
+ *  job, prefixed with its tag; the incomplete last line as well iff at EOF
+ */
+void flush_lines(struct par_job *job, bool eof) {
+    size_t start = 0;
+    char *nl;
+    while ((nl = memchr(job->buf + start, '\n', job->len - start))) {
+        printf("%s\t%.*s\n", job->tag, (int) (nl - job->buf - start), job->buf + start);
+        start = nl - job->buf + 1;
+    }
+    if (eof && start < job->len) {
+        printf("%s\t%.*s\n", job->tag, (int) (job->len - start), job->buf + start);
+        start = job->len;
+    }
+    memmove(job->buf, job->buf + start, job->len - start);
+    job->len -= start;
+    fflush(stdout);
+}
+
+/*
+ * advance: writes the buffered output of the finished jobs in order, up to the oldest
+ *  unfinished job, whose buffered output is written as well, so it can be streamed
+ */
+void advance(struct runner *r) {
+    if (r->tag)
+        return;
+    while (r->next < r->nb) {
+        struct par_job *job = &r->jobs[r->next];
+        if (job->len)
+            fwrite(job->buf, 1, job->len, stdout);
+        job->len = 0;
+        if (job->pid != 0 || job->fd != -1)
+            break;
+        free(job->buf);
+        job->buf = NULL;
+        r->next++;
+    }
+    fflush(stdout);
+}
+
+/*
+ * append: appends the provided output to the buffer of the provided job
+ */
+void append(struct par_job *job, const char *data, size_t n) {
+    if (job->len + n > job->size) {
+        size_t size = job->size ? job->size : PARALLEL_CHUNK_SIZE;
+        while (size < job->len + n)
+            size *= 2;
+        char *new = realloc(job->buf, size);
+        if (!new) {
+            printerrno("parallel: couldn't buffer the output of a job");
+            exit(EXIT_FAILURE);
+        }
+        job->buf = new;
+        job->size = size;
+    }
+    memcpy(job->buf + job->len, data, n);
+    job->len += n;
+}
+
+/*
+ * env_size: returns the nb of bytes the environment takes in the ARG_MAX of a new process
+ */
+long env_size(void) {
+    long size = 0;
+    char **env;
+    for (env = environ; *env; env++)
+        size += strlen(*env) + 1 + sizeof(char*);
+    return size;
+}
@@ -0,0 +1,38 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_PARALLEL_H_INCLUDED
+#define JSH_PARALLEL_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+/*
+ * parallel: the 'parallel' built-in: parallel [-j N] [-n N] [--tag] cmd [word...] [::: arg...]
+ *  Runs cmd for the provided args (one arg per line on stdin iff there's no ':::'), with at
+ *  most N jobs at once (default: the nb of online CPUs). The args are packed into batches of
+ *  at most '-n' args (default: 1) that fit in ARG_MAX, one whenever a job can be started;
+ *  a batch's args replace a '{}' word in the cmd, or are appended to it.
+ *  The output of the jobs is written in the order of the args, or with '--tag' line by line
+ *  as it arrives, prefixed with the batch's args.
+ *  returns EXIT_SUCCESS iff all jobs succeeded, else the nb of failed jobs (at most 101)
+ */
+int parallel(char **argv, int argc);
+
+#endif // JSH_PARALLEL_H_INCLUDED
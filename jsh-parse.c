@@ -19,33 +19,32 @@
  * ----------------------------------------------------------------------
  * jsh-parse.c: a file containing functions to parse input according to the following grammar:
  *
- * input  :=    expr
+ * input    :=  list
  *
- * expr   :=    <space>expr         // expr is a logical combination
- *              expr<space>
- *              expr #comment
- *              "expr"
- *              (expr)
- *              expr ; expr
- *              expr && expr
- *              expr || expr
+ * list     :=  and_or ((';' | '\n' | '&') and_or)*    // empty list items are ignored;
+ *                                                  // '&': the and_or runs in the background
+ *
+ * and_or   :=  pipeline (('&&' | '||') pipeline)*  // evaluated from left to right
+ *
+ * pipeline :=  ['time'] stage ('|' stage)*     // stage is the unit of truth value evaluation
+ *                                              // 'time': report the resources used per stage
+ *
+ * stage    :=  '(' list ')' redir*             // a group is replaced by its truth value (T | F)
  *              cmd
  *
- * cmd    :=    cmd | cmd           // cmd is the unit of truth value evaluation
- *              cmd >> path         // note: pipe redirection get priority over explicit redirection
- *              cmd 2> path
- *              cmd > path
- *              cmd < path
- *              cmd &               *TODO
- *              comd
+ * cmd      :=  (word | redir)+                 // cmd is the unit of fork / built_in
+ *                                              // note priority: alias > built_in > executable
+ *
+ * redir    :=  '<' word | '>' word | '>>' word | '2>' word
  *
- * comd   :=    comd option         // comd is the unit of fork / built_in
- *              comd "option with spaces"   // TODO? e.g. echo "ik ben jo" en git commit -m "dit is een message"
- *              alias               // note priority: alias > built_in > executable
- *              built_in
- *              executable_path     // relative (using the PATH env var) or absolute
+ * word     :=  (char | '\'char | '"' chars '"')+   // '#' at the start of a word: comment
  * ----------------------------------------------------------------------
  *
+ * A line is first split into a token stream by lex() (jsh-lex.c) in a single pass, then
+ *  parse() builds an immutable abstract syntax tree from the tokens, again in a single pass,
+ *  and finally evaluate() walks the tree, creating the comd structs for execute() on the fly.
+ *  Parsing a line thus takes linear time and nothing is executed for a line with a parse error.
+ *
  * e.g.  :  ls / -l  >> out.txt && cat < out.txt | grep --color=auto -B 2 usr ; pwd
  *          (ls -al > outfile && cat outfile | grep jsh | wc -w ) &&(pwd || echo i am not executing);echo final
  *          (../exit -1&&echo i am not executing ||echo me neither); pwd
@@ -55,333 +54,757 @@
  *          (debug off && (echo cur dir is && pwd) && (history | grep ls | shcat | cat | shcat | ../mini-grep pwd | 
  *              cat | shcat | shcat | ../mini-grep shcat)) #comment
  *          echo hi  # dit ~ is (commentaar) && pwd ; dit (((ook cd && ### echo jo )
- *
- * TODO     alias replacement between () for truth value?
  */
 
+#define _GNU_SOURCE     // F_SETPIPE_SZ on Linux
 #include "jsh-parse.h"
+#include "jsh-jobs.h"
+#include "jsh-cache.h"
+#include "jsh-func.h"
+#include <spawn.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+
+struct arena line_arena = ARENA_INIT;
+char *pending_expr = NULL;          // the lines of an incomplete function definition, if any
+
+#define RESOLVE_TRUTH_VAL(rv) ((rv == EXIT_SUCCESS)? "T" : "F") // note: 'T' and 'F' are built-ins
+#define NODE_KIDS_INIT_SIZE     4       // initial nb of kids allocated per list node
+#define STACK_INIT_SIZE         16      // initial nb of frames allocated for the parse and eval work stacks
+#define DEFAULT_MAX_DEPTH       10000   // default max nesting depth of groups
+#define PIPE_MAX_SIZE_FILE      "/proc/sys/fs/pipe-max-size"    // the max pipe capacity for unprivileged users
+
+#ifndef NOSPAWN
+    #define DEFAULT_USE_SPAWN   true
+#else
+    #define DEFAULT_USE_SPAWN   false
+#endif
+
+int MAX_DEPTH = DEFAULT_MAX_DEPTH;
+bool USE_SPAWN = DEFAULT_USE_SPAWN;
+bool PIPEFAIL = false;
+int PIPE_SIZE = 0;
+
+extern char **environ;
+
+/*
+ * the parser state: a cursor in the token stream of a line
+ */
+struct parser {
+    const char *line;
+    struct tokens *ts;
+    size_t pos;
+    struct arena *arena;    // holds the syntax tree
+    bool *incomplete;       // iff not NULL, set instead of reporting an unclosed function body
+};
+
+/*
+ * an open list on the parser's work stack: the top level list or the body of a group or
+ *  function. The and-or chain and pipeline are the ones currently being parsed in the list,
+ *  if any.
+ */
+struct parse_frame {
+    struct node *group;         // the group or function this list is the body of; NULL for the top level
+    size_t body_start;          // function bodies only: the source position after the '{'
+    struct node *list;
+    size_t item_start;          // the source position of the list item being parsed
+    size_t list_size;           // allocated sizes of the kids (and ops) arrays
+    struct node *chain;
+    size_t chain_size;
+    size_t ops_size;
+    struct node *pipeline;
+    size_t pipeline_size;
+    bool timed;                 // whether or not the next pipeline is prefixed with 'time'
+};
+
+/*
+ * a node on the evaluator's work stack
+ */
+struct eval_frame {
+    struct node *node;
+    size_t i;                   // the index of the next kid to evaluate
+    bool pending;               // PIPELINE only: kids[i] is a group that is being evaluated
+    char **truth;               // PIPELINE only: the truth values (T | F) of the evaluated groups
+    struct pipeline_timer *timer;   // timed PIPELINE only
+};
+
+/*
+ * the outcome of a stage of a pipeline, as recorded by execute()
+ */
+struct stage_result {
+    const char *name;           // the command name
+    pid_t pid;                  // the child process that is still to be reaped, or 0
+    int status;                 // the exit status, as returned by execute()
+    struct rusage ru;           // timed pipelines only: the resources used by the stage
+    double wall;                // timed pipelines only: the nb of seconds until the stage completed
+};
+
+/*
+ * the state of a pipeline prefixed with 'time' on the evaluator's work stack
+ */
+struct pipeline_timer {
+    double start;
+    struct rusage self;         // the resource usage of jsh and of its children at the start
+    struct rusage children;
+    struct stage_result *res;   // the stages iff the pipeline was executed; NULL for a sole group
+    size_t nb;
+};
 
-#define RESOLVE_TRUTH_VAL(rv) ((rv == EXIT_SUCCESS)? 'T' : 'F') // note: 'T' and 'F' are built-ins
+/*
+ * the exit status of each stage of the last executed pipeline, for the 'pipestatus' built-in
+ */
+struct {
+    int *status;
+    size_t nb;
+    size_t size;
+} last_pipeline = {NULL, 0, 0};
 
 // #################### helper function definitions ####################
-comd *createcomd(char**);
-void freecomdlist(comd*);
-int parsecmd(char**, int);
-int execute(comd*, int);
+struct node *parse_input(struct parser*);
+struct node *parse_command(struct parser*);
+bool parse_redir(struct parser*, struct node*);
+struct node *newnode(struct parser*, enum node_type);
+bool has_params(struct parser*, struct token*);
+void addkid(struct parser*, struct node*, struct node*, size_t*);
+bool parse_error(struct parser*);
+int run_pipeline(struct node*, char**, struct pipeline_timer*);
+comd *createcomd(char**, int, struct node*);
+int execute(comd*, int, struct stage_result*);
+bool reap_stage(struct stage_result*, int, double);
+struct pipeline_timer *start_timer(void);
+void print_times(struct node*, struct pipeline_timer*, int);
+double clock_seconds(void);
+double tv_seconds(struct timeval);
 void redirectstreams(comd*, int, int);
+void resize_pipe(int);
 int exec_built_in(comd*, int, int);
+int exec_function(comd*, int, int);
 extern int is_built_in(comd*);
 extern int parse_built_in(comd*, int);
 
+#define CUR(p)      ((p)->ts->toks[(p)->pos])
+#define IS_KEYWORD(t, word)     ((t).type == TOK_WORD && !(t).quoted && !strcmp((t).text, (word)))
+
 /*
- * createcomd: returns a pointer to a newly created comd struct, 
- *  using defaults: {cmd, lengthof(cmd), NULL, NULL, NULL, 0, NULL}
- *  The caller should free() the returned comd after use, e.g. using the freecomdlist() function.
+ * createcomd: returns a pointer to a newly created comd struct for the provided argv array and
+ *  the redirections of the provided node, using defaults: {cmd, argc, NULL, NULL, NULL, 0, NULL}
+ *  The cmd array is copied into the same allocation, so built_ins may freely modify it.
+ *  The comd is allocated in the line_arena and lives until the arena is released.
+ *  Inside a function call, the positional parameters in the node's flagged words are substituted.
  */
-comd *createcomd(char **cmd) {
-    comd *ret = malloc(sizeof(comd));   //TODO chkerr
-    ret->cmd = cmd;
-    
-    // calculate cmd length
-    int i, length = 0;
-    for (i = 0; cmd[i] != NULL; i++)
-        length++;
-    
-    ret->length = length;
-    ret->inf = NULL;
-    ret->outf = NULL;
-    ret->errf = NULL;
-    ret->append_out = 0;
+comd *createcomd(char **argv, int argc, struct node *redir) {
+    if (redir->params)
+        argv = func_expand(argv, &argc, redir->params);
+    comd *ret = arena_alloc(&line_arena, sizeof(comd) + sizeof(char*) * (argc + 1));
+    ret->cmd = (char**) (ret + 1);
+    memcpy(ret->cmd, argv, sizeof(char*) * argc);
+    ret->cmd[argc] = NULL;
+    ret->length = argc;
+    ret->inf = redir->inf;
+    ret->outf = redir->outf;
+    ret->errf = redir->errf;
+    ret->append_out = redir->append_out;
     ret->next = NULL;
     return ret;
 }
 
 /*
- * free()s the provided comd chain
+ * parseexpr: expands the aliases in the '\0' terminated expr string, parses it according to the
+ *  'input' grammar and evaluates it. returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of
+ *  executed expression
  */
-void freecomdlist(comd *list) {
-    comd *cur = list;
-    while (cur != NULL) {
-        printdebug("freeing comd struct for '%s'", *cur->cmd);
-        comd *temp = cur;
-        cur = cur->next;
-        free(temp);
-   }
+int parseexpr(char *expr) {
+    // parseexpr() is re-entered by e.g. the source built_in: only release this line's memory
+    arena_mark mark = arena_save(&line_arena);
+    size_t allocs = line_arena.nb_allocs;
+    int rv = EXIT_FAILURE;
+
+    // continue an incomplete function definition from the previous line(s)
+    //  (the "\n" parsestream() passes after each line is implied by the joining)
+    char *joined = NULL;
+    if (pending_expr && strcmp(expr, "\n") == 0)
+        return EXIT_SUCCESS;
+    if (pending_expr) {
+        expr = joined = concat(3, pending_expr, "\n", expr);
+        free(pending_expr);
+        pending_expr = NULL;
+    }
+
+    // the tree is kept in the parse cache; it's pinned until the evaluation is done
+    struct cached_line *pin;
+    bool incomplete = false;
+    ast *tree = cache_get(expr, &pin, &incomplete);
+    if (tree) {
+        rv = evaluate(tree->root);
+        cache_put(pin);
+        printdebug("parseexpr: expr evaluated with return value %d", rv);
+    }
+    else if (incomplete) {
+        printdebug("parseexpr: function body not closed; continuing on the next line");
+        pending_expr = strclone(expr);
+        rv = EXIT_SUCCESS;
+    }
+    free(joined);
+    printdebug("arena: line used %zu bytes in %zu allocations (high water %zu bytes in %zu chunks)",
+        line_arena.used - mark.used, line_arena.nb_allocs - allocs, line_arena.high_water,
+        line_arena.nb_chunks);
+    arena_release(&line_arena, mark);
+    return rv;
 }
 
-/**
- * TODO also take aliases etc into account
+/*
+ * parse_pending: whether or not the last expr was an incomplete function definition
  */
-int parse_from_file(char *line) {
-    char *resolved = resolvealiases(line);
-    int rv = parseexpr(resolved);
-    free(resolved);
-    return rv;
+bool parse_pending(void) {
+    return pending_expr != NULL;
 }
 
 /*
- * parseexpr: parses the '\0' terminated expr string recursivly, according to the 'expr' grammar.
- * returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of executed expression
+ * parse_end_input: reports and discards the incomplete function definition, if any
  */
-//int parseexpr(char **expr, int length) { //TODO length arg?? ipv null term string
-int parseexpr(char *expr) {
-    int resolvebrackets(char*, int);          //helper functions declarations
-    int splitexpr(char*, char***);
-    int length = strlen(expr);
-    int i, rv;
-    bool inquotes = false;
-    
-    /**** 0. skip all leading spaces tabs and newlines ****/
-    int k =  strspn(expr, " \t\n");
-    expr = expr + k;
-    if (k)
-        printdebug("parseexpr: skipped %d leading spaces/tabs", k);
-    
-    /**** 1. BRACKETS: resolve, if any ****/
-    if ((rv = resolvebrackets(expr, length)) != -1)
-        return rv;
-    
-    /**** 2. OPERATORS: first subexpression (till first logic operator) has no more brackets ****/
-    for (i = 0; i < length; i++) {
-        if (inquotes && (expr[i] != '"' || expr[i-1] == '\\'))
-            continue;   //(unescaped) quotes protect their content from being interpreted
-        else if (expr[i] == '#') {
-            expr[i] = '\0';
-            return parseexpr(expr);    
-        }
-        else if (expr[i] == '"' && (i == 0 || expr[i-1] != '\\')) {
-            inquotes = inquotes?false:true;
-        }
-        else if (expr[i] == ';') {
-            expr[i] = '\0';
-            parseexpr(expr);
-            return parseexpr(expr+i+1);
-        }
-        else if (strncmp(expr+i, "&&", 2) == 0) {
-            expr[i] = '\0';
-            if (parseexpr(expr) == EXIT_SUCCESS)
-                return parseexpr(expr+i+2);
-            else
-                return EXIT_FAILURE;
-        }
-        else if (strncmp(expr+i, "||", 2) == 0) {
-            expr[i] = '\0';
-            if (parseexpr(expr) != EXIT_SUCCESS)
-                return parseexpr(expr+i+2);
-            else
-                return EXIT_SUCCESS;
-        }
-    }
-    
-    /**** 3. BASE: expr is a cmd ****/
-    char **curcmd;
-    length = splitexpr(expr, &curcmd);      // split the expression, using space as a delimiter
-    rv = parsecmd(curcmd, length);
-    printdebug("parseexpr: expr evaluated with return value %d", rv);
-    return rv;
+void parse_end_input(const char *source) {
+    if (!pending_expr)
+        return;
+    printerr("parse error: unexpected end of %s in function definition '%s'", source, pending_expr);
+    parse_discard_input();
 }
 
 /*
- * resolvebrackets helper function: recursively resolve any subexpression *directly* following an opening '(' left bracket
- *  returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of executed expression or -1 if no brackets where evaluated.
+ * parse_discard_input: silently discards the incomplete function definition, if any
  */
-int resolvebrackets(char *expr, int length) {
-    char *l = strchr(expr,'('); // pointer to first '('
-    if (l == NULL || l > expr) // '(' must be at the start of expr
-        return -1;
-    
-    int i, rv, count = 0;
-    char *r = NULL;
-    // 1. find pointer *r to matching ')'
-    for (i = 1; i < length; i++)
-        if (expr[i] == '(')
-            count++;
-        else if (expr[i] == ')') {
-            if (count == 0) {
-                r = expr + i;
-                break;
-            }
-            else
-                count--;
+void parse_discard_input(void) {
+    free(pending_expr);
+    pending_expr = NULL;
+}
+
+/*
+ * parse: returns a syntax tree for the provided line, allocated in the provided arena, or NULL
+ *  after printing an error message iff the line doesn't match the grammar
+ */
+ast *parse(const char *line, struct arena *a, bool *incomplete) {
+    ast *tree = arena_alloc(a, sizeof(ast));
+    struct parser p = {line, &tree->tokens, 0, a, incomplete};
+    lex(line, &tree->tokens, a);
+    if (tree->tokens.unbalanced)
+        printerr("parse error: unbalanced quoting -> added end quotes \"%s\"...",
+            tree->tokens.toks[tree->tokens.nb - 2].text);
+
+    tree->root = parse_input(&p);
+    return tree->root ? tree : NULL;
+}
+
+/*
+ * parse_input: input := list, without recursion: nested groups are parsed with an explicit,
+ *  heap allocated work stack of open lists, so only MAX_DEPTH limits the nesting depth.
+ *
+ *  list     :=  and_or ((';' | '\n' | '&') and_or)*
+ *  and_or   :=  pipeline (('&&' | '||') pipeline)*
+ *  pipeline :=  ['time'] stage ('|' stage)*
+ *  stage    :=  '(' list ')' redir* | funcdef | cmd
+ *  funcdef  :=  word '(' ')' '{' list '}'
+ *
+ *  'time' is only a keyword as an unquoted word at the start of a pipeline that is followed by
+ *  a stage; else it's an ordinary word, e.g. 'time' alone or 'echo time'. Likewise, '{' is only
+ *  a keyword right after 'name()' and '}' at the start of a command in a function body, e.g.
+ *  'f() { echo hi ; }'. A function definition is a pipeline of its own.
+ *  A line ending in an unclosed function body is incomplete, iff p->incomplete is set.
+ */
+struct node *parse_input(struct parser *p) {
+    size_t depth = 0, size = STACK_INIT_SIZE;
+    struct parse_frame *stack = arena_calloc(p->arena, sizeof(struct parse_frame) * size);
+    struct parse_frame *f;
+    struct node *stage = NULL;
+    size_t group_size;
+    enum {AT_ITEM, AT_STAGE, AFTER_STAGE} state = AT_ITEM;
+
+    stack[0].list = newnode(p, NODE_LIST);
+    while (true) {
+        f = &stack[depth];
+        switch (state) {
+            case AT_ITEM:
+                /**** the start of a list item: skip empty items, check for the end of the list ****/
+                while (CUR(p).type == TOK_SEMI)
+                    p->pos++;
+                if (CUR(p).type == TOK_END) {
+                    if (depth == 0)
+                        return f->list;
+                    if (f->group->type == NODE_FUNCTION) {
+                        // the body may continue on the next line
+                        if (p->incomplete)
+                            *p->incomplete = true;
+                        else
+                            printerr("parse error: function body not closed with '}' when evaluating '%s'", p->line);
+                        return NULL;
+                    }
+                    printerr("parse error: unbalanced parenthesis when evaluating '%s'", p->line);
+                    return NULL;
+                }
+                if (depth > 0 && f->group->type == NODE_FUNCTION && IS_KEYWORD(CUR(p), "}")) {
+                    // close the function body, keeping its source text to parse it on definition
+                    stage = f->group;
+                    stage->text = arena_alloc(p->arena, CUR(p).start - f->body_start + 1);
+                    memcpy(stage->text, p->line + f->body_start, CUR(p).start - f->body_start);
+                    stage->text[CUR(p).start - f->body_start] = '\0';
+                    p->pos++;
+                    group_size = 0;
+                    addkid(p, stage, f->list, &group_size);
+                    depth--;
+                    state = AFTER_STAGE;
+                    continue;
+                }
+                if (CUR(p).type == TOK_RPAREN && depth > 0 && f->group->type == NODE_GROUP) {
+                    // close the group and continue parsing its pipeline in the enclosing list
+                    p->pos++;
+                    stage = f->group;
+                    group_size = 0;
+                    addkid(p, stage, f->list, &group_size);
+                    depth--;
+                    while (CUR(p).type >= TOK_IN && CUR(p).type <= TOK_ERR)
+                        if (!parse_redir(p, stage))
+                            return NULL;
+                    state = AFTER_STAGE;
+                    continue;
+                }
+                f->item_start = CUR(p).start;
+                state = AT_STAGE;
+                continue;
+
+            case AT_STAGE:
+                /**** the start of a pipeline stage: open a group or parse a cmd ****/
+                if (!f->pipeline && !f->timed && CUR(p).type == TOK_WORD && !CUR(p).quoted &&
+                        !strcmp(CUR(p).text, "time")) {
+                    enum token_type next = p->ts->toks[p->pos+1].type;
+                    if (next == TOK_WORD || next == TOK_LPAREN || (next >= TOK_IN && next <= TOK_ERR)) {
+                        f->timed = true;
+                        p->pos++;
+                        continue;
+                    }
+                }
+                bool funcdef = (!f->pipeline && !f->timed && CUR(p).type == TOK_WORD && !CUR(p).quoted &&
+                    p->ts->toks[p->pos+1].type == TOK_LPAREN && p->ts->toks[p->pos+2].type == TOK_RPAREN &&
+                    IS_KEYWORD(p->ts->toks[p->pos+3], "{"));
+                if (funcdef || CUR(p).type == TOK_LPAREN) {
+                    if (depth >= (size_t) MAX_DEPTH) {
+                        printerr("parse error: groups nested deeper than the max depth %d at position %zu "
+                            "(see 'set maxdepth')", MAX_DEPTH, CUR(p).start);
+                        return NULL;
+                    }
+                    struct node *group = newnode(p, funcdef ? NODE_FUNCTION : NODE_GROUP);
+                    if (funcdef) {
+                        group->argv = arena_alloc(p->arena, sizeof(char*) * 2);
+                        group->argv[0] = CUR(p).text;
+                        group->argv[1] = NULL;
+                        group->argc = 1;
+                        p->pos += 3;    // 'name', '(' and ')'
+                    }
+                    p->pos++;
+                    if (++depth == size) {
+                        stack = arena_grow(p->arena, stack, sizeof(struct parse_frame) * size,
+                            sizeof(struct parse_frame) * 2 * size);
+                        size *= 2;
+                    }
+                    f = &stack[depth];
+                    memset(f, 0, sizeof(struct parse_frame));
+                    f->group = group;
+                    f->body_start = p->ts->toks[p->pos-1].end;
+                    f->list = newnode(p, NODE_LIST);
+                    state = AT_ITEM;
+                    continue;
+                }
+                if (!(stage = parse_command(p)))
+                    return NULL;
+                // fall through
+
+            case AFTER_STAGE:
+                /**** a stage was parsed: add it to the pipeline ****/
+                if (stage->type == NODE_FUNCTION && (f->pipeline || CUR(p).type == TOK_PIPE)) {
+                    printerr("parse error: a function definition can't be part of a pipeline in '%s'", p->line);
+                    return NULL;
+                }
+                if (!f->pipeline) {
+                    f->pipeline = newnode(p, NODE_PIPELINE);
+                    f->pipeline_size = 0;
+                    f->pipeline->timed = f->timed;
+                    f->timed = false;
+                }
+                addkid(p, f->pipeline, stage, &f->pipeline_size);
+                if (CUR(p).type == TOK_PIPE) {
+                    p->pos++;
+                    state = AT_STAGE;
+                    continue;
+                }
+
+                /**** the pipeline is complete: add it to the and-or chain iff followed by '&&' or '||' ****/
+                if (CUR(p).type == TOK_AND || CUR(p).type == TOK_OR) {
+                    if (!f->chain) {
+                        f->chain = newnode(p, NODE_AND_OR);
+                        f->chain_size = f->ops_size = 0;
+                    }
+                    addkid(p, f->chain, f->pipeline, &f->chain_size);
+                    // chain->ops is kept as large as chain->kids
+                    if (f->ops_size < f->chain_size) {
+                        f->chain->ops = arena_grow(p->arena, f->chain->ops, sizeof(enum token_type) *
+                            f->ops_size, sizeof(enum token_type) * f->chain_size);
+                        f->ops_size = f->chain_size;
+                    }
+                    f->chain->ops[f->chain->nb-1] = CUR(p).type;
+                    f->pipeline = NULL;
+                    p->pos++;
+                    state = AT_STAGE;
+                    continue;
+                }
+
+                /**** the and-or item is complete: add it to the list ****/
+                struct node *item = f->pipeline;
+                if (f->chain) {
+                    addkid(p, f->chain, f->pipeline, &f->chain_size);
+                    item = f->chain;
+                }
+                addkid(p, f->list, item, &f->list_size);
+                f->chain = f->pipeline = NULL;
+                if (CUR(p).type == TOK_AMP) {
+                    // keep the item's source text for the job table
+                    size_t end = p->ts->toks[p->pos-1].end;
+                    item->background = true;
+                    item->text = arena_alloc(p->arena, end - f->item_start + 1);
+                    memcpy(item->text, p->line + f->item_start, end - f->item_start);
+                    item->text[end - f->item_start] = '\0';
+                    p->pos++;
+                    state = AT_ITEM;
+                    continue;
+                }
+                if (CUR(p).type != TOK_SEMI && CUR(p).type != TOK_END &&
+                    !(depth > 0 && CUR(p).type == TOK_RPAREN)) {
+                    parse_error(p);
+                    return NULL;
+                }
+                state = AT_ITEM;
+                continue;
         }
-    
-    if (r == NULL) {
-        printerr("parse errror: unbalanced parenthesis when evaluating '%s'", expr);
-        return EXIT_FAILURE;
     }
-        
-    // 2. (recursively) parse the expression between brackets
-    *r = '\0';
-    printdebug("resolvebrackets: now evaluating '%s'", l+1);
-    rv = parseexpr(l+1);
-        
-    /* 3. parse the remainder of the expression, replacing the evaluated subexpression with 
-    its built-in truth value (T | F), using memmove for overlapping memory
-        [--> no buf overflow, since at least 2 chars '(' and ')' are replaced with a single 'T' or 'F' char]
-    */
-    *l = RESOLVE_TRUTH_VAL(rv);
-    memmove(l + 1, r + 1, strlen(r+1)+1); // len+1 : also copy the '\0'
-    printdebug("resolvebrackets: input resolved to '%s'", l);
-    return parseexpr(l);
 }
 
 /*
- * splitexpr helper function: splits a '\0' terminated input string *expr, using space as a delimiter. Note spaces can be '\ ' escaped.
- *  initializes the provided pointer ***ret to point to a NULL terminated array of pointers to *expr space-delimited-substrings
- *  returns curcmd array length
- *  TODO DONE NOTE: this funtion expects an expr without redundant spaces (as is converted by resolvealiases() for example)
+ * parse_command: cmd := (word | redir)+
+ *  The words that refer to positional parameters are flagged in cmd->params.
  */
-int splitexpr(char *expr, char ***ret) {
-    static char **curcmd = NULL;        // array of pointers to current cmd and its arguments
-    static int curcmd_realloc = 0;      // total nb of reallocations for curcmd
-    int j = 0;                          // index in curcmd[] array
-    int length = strlen(expr);
-    
-    #define CMD_OPT_ALLOC_UNIT  10      // unit of re-allocation for curcmd[]
-    #define REALLOC_CURCMD \
-        if (!(curcmd = realloc(curcmd, sizeof (char*) * CMD_OPT_ALLOC_UNIT * ++curcmd_realloc))) { \
-            printf("FAILED"); \
-            printerrno("Running out of memory. Exiting"); \
-            exit(EXIT_FAILURE); \
-        }
-    
-    // 0. allocate init space on the heap
-    if (!curcmd_realloc)
-        REALLOC_CURCMD;
-    
-    // 1. skip all leading spaces
-    int i = strspn(expr, " ");
-    char *ch = expr + i;             // ch is pointer to the next token to add
-        
-    // 2. split using space as a delimiter
-    for (; i < length; i++) {
-        // allow escaping (i.e. skipping) the next char
-        #define CHK_ESCAPING(index) \
-            if (expr[index] == '\\' && index < length-1) { \
-                printdebug("escaping char '%c' in '%s'", expr[index+1], ch); \
-                memmove(expr+index, expr+index+1, strlen(expr+index+1) + 1); \
-                length--; \
-                index++; \
-            }
-            
-        CHK_ESCAPING(i)
-        if (expr[i] == '"') { //TODO TODO doc -> protect content
-            expr[i] = '\0';
-            if (ch < expr + i)
-                curcmd[j++] = ch; //TODO realloc??
-            ch = expr + i + 1;
-            int k;
-            bool found = false;
-            for (k=i+1; k < length && !found; k++) {
-                CHK_ESCAPING(k)
-                if (expr[k] == '"') {
-                    expr[k] = '\0';                
-                    curcmd[j++] = ch; //TODO realloc??
-                    ch = expr + k + 1;
-                    found = true;
+struct node *parse_command(struct parser *p) {
+    struct node *cmd = newnode(p, NODE_COMMAND);
+    size_t size = 0;
+    while (true) {
+        if (CUR(p).type == TOK_WORD) {
+            if ((size_t) cmd->argc + 1 >= size) {
+                size_t new = size ? 2 * size : NODE_KIDS_INIT_SIZE;
+                cmd->argv = arena_grow(p->arena, cmd->argv, sizeof(char*) * size, sizeof(char*) * new);
+                if (cmd->params) {
+                    cmd->params = arena_grow(p->arena, cmd->params, sizeof(bool) * size, sizeof(bool) * new);
+                    memset(cmd->params + size, 0, sizeof(bool) * (new - size));
                 }
+                size = new;
             }
-            if (!found)
-                printerr("parse errror: unbalanced quoting -> added end quotes \"%s\"...", ch);
-            i = k-1;
+            if (has_params(p, &CUR(p))) {
+                // only allocated for the (few) cmds that refer to positional parameters
+                if (!cmd->params)
+                    cmd->params = arena_calloc(p->arena, sizeof(bool) * size);
+                cmd->params[cmd->argc] = true;
+            }
+            cmd->argv[cmd->argc++] = CUR(p).text;
+            p->pos++;
         }
-        else if (expr[i] == ' ') {
-            expr[i] = '\0';
-            if (ch < expr + i)    //TODO TODO doc
-                curcmd[j++] = ch;
-            ch = expr + i + 1;
-            // realloc curcmd[] if needed
-            if (j >= CMD_OPT_ALLOC_UNIT * curcmd_realloc)
-                REALLOC_CURCMD;
+        else if (CUR(p).type >= TOK_IN && CUR(p).type <= TOK_ERR) {
+            if (!parse_redir(p, cmd))
+                return NULL;
         }
+        else
+            break;
     }
-    
-    if (j == 0 || *ch) // ignore trailing spaces
-        curcmd[j++] = ch; // add trailing token        
-    curcmd[j] = NULL;
-    
-    *ret = curcmd;  // set provided pointer
-    return j;       // return curcmd array length
+    if (cmd->argc == 0) {
+        // e.g. '&& cmd', 'cmd | | cmd' or a redirection without a command
+        parse_error(p);
+        return NULL;
+    }
+    cmd->argv[cmd->argc] = NULL;
+    return cmd;
 }
 
 /*
- * parsecmd: parses the space delimited cmd[lenght] array, according to the 'cmd' grammar.
- *  returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of executed cmd
+ * parse_redir: redir := ('<' | '>' | '>>' | '2>') word
+ *  stores the redirection target in the provided node; a later redirection overrides an earlier one
  */
-int parsecmd(char **cmd, int length) {
-    comd *pipeline_head = createcomd(cmd);
-    comd *pipeline_tail = pipeline_head;
-    
-    #define CHK_FILE(op) \
-        if (i >= length - 1) { \
-            printerr("parse error: no file specified after redirection operator '%s'", op); \
-            return EXIT_FAILURE; \
-        }
-    
-    int i, nbpipes;
-    for (i = 0, nbpipes = 0; i < length; i++) {
-        if (*cmd[i] == '|') {
-            cmd[i] = NULL;
-            pipeline_tail->length = i;
-            comd *new = createcomd(cmd+i+1);
-            pipeline_tail->next = new;
-            pipeline_tail = new;
-            nbpipes++;
-        }
-        else if (*cmd[i] == '<') {
-            CHK_FILE("<")
-            cmd[i++] = NULL;
-            pipeline_tail->inf = cmd[i];
-        }
-        else if (strncmp(cmd[i], ">>", 2) == 0) {
-            CHK_FILE(">>")
-            cmd[i++] = NULL;
-            pipeline_tail->outf = cmd[i];
-            pipeline_tail->append_out = 1;
-        }
-        else if (strncmp(cmd[i], "2>", 2) == 0) {
-            CHK_FILE("2>")
-            cmd[i++] = NULL;
-            pipeline_tail->errf = cmd[i];
+bool parse_redir(struct parser *p, struct node *node) {
+    enum token_type op = CUR(p).type;
+    p->pos++;
+    if (CUR(p).type != TOK_WORD) {
+        printerr("parse error: no file specified after redirection operator '%s'", token_name(op));
+        return false;
+    }
+    char *path = CUR(p).text;
+    p->pos++;
+    switch (op) {
+        case TOK_IN:
+            node->inf = path;
+            break;
+        case TOK_OUT:
+        case TOK_APPEND:
+            node->outf = path;
+            node->append_out = (op == TOK_APPEND);
+            break;
+        default:
+            node->errf = path;
+    }
+    return true;
+}
+
+/*
+ * parse_error: prints an error message for the current token of the provided parser
+ * @return: false, for convenience
+ */
+bool parse_error(struct parser *p) {
+    struct token *t = &CUR(p);
+    if (t->type == TOK_END)
+        printerr("parse error: unexpected end of line in '%s'", p->line);
+    else
+        printerr("parse error near '%.*s' at position %zu in '%s'", (int) (t->end - t->start),
+            p->line + t->start, t->start, p->line);
+    return false;
+}
+
+/*
+ * has_params: returns whether or not the source of the provided word token contains an
+ *  unescaped '$' followed by a positional parameter char (a digit, '#', '@' or '*')
+ */
+bool has_params(struct parser *p, struct token *t) {
+    size_t i;
+    for (i = t->start; i + 1 < t->end; i++)
+        if (p->line[i] == '$' && (i == t->start || p->line[i-1] != '\\') &&
+                strchr("0123456789#@*", p->line[i+1]))
+            return true;
+    return false;
+}
+
+/*
+ * newnode: returns a new, empty syntax tree node of the provided type in the parser's arena
+ */
+struct node *newnode(struct parser *p, enum node_type type) {
+    struct node *node = arena_calloc(p->arena, sizeof(struct node));
+    node->type = type;
+    return node;
+}
+
+/*
+ * addkid: appends a kid to the provided node, growing its kids array iff needed
+ * @arg size: the current allocated size of the kids array
+ */
+void addkid(struct parser *p, struct node *node, struct node *kid, size_t *size) {
+    if (node->nb == *size) {
+        size_t new = *size ? 2 * *size : NODE_KIDS_INIT_SIZE;
+        node->kids = arena_grow(p->arena, node->kids, sizeof(struct node*) * *size, sizeof(struct node*) * new);
+        *size = new;
+    }
+    node->kids[node->nb++] = kid;
+}
+
+/*
+ * evaluate: evaluates the provided syntax tree node, without recursion: the nodes under
+ *  evaluation are kept on an explicit, heap allocated work stack.
+ *  returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of the evaluated node
+ *
+ *  - a list evaluates all its items; its status is the status of the last item. An item
+ *    followed by '&' is launched as a background job (see jsh-jobs.c) with status EXIT_SUCCESS
+ *  - an and-or chain evaluates its pipelines from left to right; a pipeline following '&&'
+ *    only runs iff the status so far is EXIT_SUCCESS, following '||' only iff not
+ *  - a pipeline first evaluates its groups, replacing them with their built-in truth
+ *    value (T | F), and then executes its comds. A pipeline prefixed with 'time' reports the
+ *    resources it used on stderr afterwards
+ *  - a function definition (always a pipeline of its own) defines the function; its status
+ *    is EXIT_SUCCESS iff the body could be parsed
+ */
+int evaluate(struct node *root) {
+    arena_mark mark = arena_save(&line_arena);
+    size_t depth = 0, size = STACK_INIT_SIZE, i;
+    struct eval_frame *stack = arena_alloc(&line_arena, sizeof(struct eval_frame) * size);
+    int rv = EXIT_SUCCESS;
+
+    // push a node on the work stack; invalidates any pointer to a frame
+    #define PUSH(n) \
+        do { \
+            if (depth == size) { \
+                stack = arena_grow(&line_arena, stack, sizeof(struct eval_frame) * size, \
+                    sizeof(struct eval_frame) * 2 * size); \
+                size *= 2; \
+            } \
+            stack[depth++] = (struct eval_frame) {(n), 0, false, NULL, NULL}; \
+        } while (false)
+
+    PUSH(root);
+    while (depth > 0) {
+        struct eval_frame *f = &stack[depth-1];
+        struct node *node = f->node;
+        switch (node->type) {
+            case NODE_LIST:
+                if (f->i == 0)
+                    rv = EXIT_SUCCESS;      // the empty list: e.g. an empty line or only a comment
+                if (f->i < node->nb) {
+                    i = f->i++;
+                    if (node->kids[i]->background)
+                        rv = jobs_launch(node->kids[i]);
+                    else
+                        PUSH(node->kids[i]);
+                    continue;
+                }
+                break;
+            case NODE_AND_OR:
+                if (f->i > 0)
+                    while (f->i < node->nb && (node->ops[f->i-1] == TOK_AND) != (rv == EXIT_SUCCESS))
+                        f->i++;
+                if (f->i < node->nb) {
+                    i = f->i++;
+                    PUSH(node->kids[i]);
+                    continue;
+                }
+                break;
+            case NODE_GROUP:
+                if (f->i++ == 0) {
+                    PUSH(node->kids[0]);
+                    continue;
+                }
+                break;
+            case NODE_PIPELINE:
+                {
+                struct node *stage = node->kids[0];
+                if (stage->type == NODE_FUNCTION) {
+                    rv = func_define(stage->argv[0], stage->text);
+                    break;
+                }
+                if (node->timed && !f->timer)
+                    f->timer = start_timer();
+                if (node->nb == 1 && stage->type == NODE_GROUP && !stage->inf && !stage->outf && !stage->errf) {
+                    if (f->i++ == 0) {
+                        PUSH(stage);
+                        continue;
+                    }
+                    break;
+                }
+                if (f->pending) {
+                    f->truth[f->i++] = RESOLVE_TRUTH_VAL(rv);
+                    f->pending = false;
+                }
+                while (f->i < node->nb && node->kids[f->i]->type != NODE_GROUP)
+                    f->i++;
+                if (f->i < node->nb) {
+                    if (!f->truth)
+                        f->truth = arena_calloc(&line_arena, sizeof(char*) * node->nb);
+                    f->pending = true;
+                    PUSH(node->kids[f->i]);
+                    continue;
+                }
+                rv = run_pipeline(node, f->truth, f->timer);
+                break;
+                }
+            case NODE_COMMAND:
+                {
+                arena_mark cmd_mark = arena_save(&line_arena);
+                rv = execute(createcomd(node->argv, node->argc, node), 0, NULL);
+                arena_release(&line_arena, cmd_mark);
+                break;
+                }
+            case NODE_FUNCTION:
+                // unreachable: a function definition is a pipeline stage, defined by NODE_PIPELINE
+                assert(false);
+                break;
         }
-        else if (*cmd[i] == '>') {
-            CHK_FILE(">")
-            cmd[i++] = NULL;
-            pipeline_tail->outf = cmd[i];
-        } 
+        // the node is evaluated and rv holds its status
+        if (f->timer)
+            print_times(node, f->timer, rv);
+        depth--;
     }
-    // base: pipeline of comds
-    return execute(pipeline_head, nbpipes);
+    arena_release(&line_arena, mark);
+    return rv;
+}
+
+/*
+ * run_pipeline: executes the provided pipeline, replacing its groups with the provided truth
+ *  values. returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of the pipeline
+ * @arg timer: iff not NULL, the resources used per stage are recorded in it
+ */
+int run_pipeline(struct node *pipeline, char **truth, struct pipeline_timer *timer) {
+    if (timer) {
+        // the stage results are reported after the pipeline completed
+        timer->nb = pipeline->nb;
+        timer->res = arena_alloc(&line_arena, sizeof(struct stage_result) * pipeline->nb);
+    }
+    // the comds are only needed during this pipeline's execution
+    arena_mark mark = arena_save(&line_arena);
+    comd *head = NULL, *tail = NULL;
+    size_t i;
+    for (i = 0; i < pipeline->nb; i++) {
+        comd *new;
+        struct node *stage = pipeline->kids[i];
+        if (stage->type == NODE_GROUP)
+            new = createcomd(&truth[i], 1, stage);
+        else
+            new = createcomd(stage->argv, stage->argc, stage);
+
+        if (tail)
+            tail->next = new;
+        else
+            head = new;
+        tail = new;
+    }
+    int rv = execute(head, pipeline->nb - 1, timer ? timer->res : NULL);
+    arena_release(&line_arena, mark);
+    return rv;
 }
 
 /*
  * execute: execute a list of comds as a pipeline, using fork and exec.
  *  specified number of pipes npipes  = (length of pipeline - 1)
- *  returns the exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of the last process in the pipeline
+ *  returns the exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of the last process in the pipeline,
+ *  or iff PIPEFAIL the status of the rightmost stage that failed. The status of every stage is
+ *  kept for the 'pipestatus' built-in.
+ * @arg res: iff not NULL, the (npipes + 1) stage results, including the resources used, are
+ *  stored in it; else they're only recorded on the stack
  *
  * Note: - pipe redirecting has priority over explicit redirecting: 
  *          e.g. ls > out | less : ls stdout will *only* be directed to less
+ *       - a built-in that is the sole cmd runs in jsh itself; a built-in in a pipeline runs in a
+ *          forked subshell (as in sh), so it streams concurrently with the other stages and its
+ *          changes to the shell state (e.g. cd, alias) don't outlive the pipeline
  */
-int execute(comd *pipeline, int npipes) {
+int execute(comd *pipeline, int npipes, struct stage_result *res) {
     int i, pfds[npipes*2];
+    bool timed = (res != NULL);
+    struct stage_result stages[timed ? 1 : npipes+1];
+    if (!timed)
+        res = stages;
+    memset(res, 0, sizeof(struct stage_result) * (npipes+1));
+    double start = timed ? clock_seconds() : 0;
+
     // 0. create n pipes and store the file descriptors
-    for (i = 0; i < npipes; i++)
+    for (i = 0; i < npipes; i++) {
         if (pipe(pfds+i*2) < 0) {
             printerrno("Couldn't create pipe");
             exit(EXIT_FAILURE);
         }
+        if (PIPE_SIZE > 0)
+            resize_pipe(pfds[i*2]);
+    }
     #define CLOSE_ALL_PIPES \
         for (k = 0; k < npipes*2; k++) \
             if (pfds[k] != -1 && close(pfds[k]) == -1) \
                 printerrno("couldn't close pipefd %d", pfds[k]);
     #define CLOSE_PREV_PIPE \
-        if (stdoutfd != -1 && close(stdoutfd) == -1) \
-            printerrno("couldn't close writing end with pipefd %d", pfds[k]); \
-        else \
-            pfds[j+1] = -1; // to indicate this side is closed
+        if (stdoutfd != -1) { \
+            if (close(stdoutfd) == -1) \
+                printerrno("couldn't close writing end with pipefd %d", stdoutfd); \
+            else \
+                pfds[j+1] = -1; /* to indicate this side is closed */ \
+        }
     
     comd *cur = pipeline;
     int j, k, status = 0, nbchildren = 0;
+    struct rusage before;
     /* 1. fork nbchildren = (npipes + 1 - nbuiltins) child processes and connect them to the pipes
         NOTE: each iteration: close the writing end of the prev pipe to indicate the parent process (jsh)
         won't use it anymore; otherwise, the next process (built_in) in the pipeline won't receive the EOF...*/
@@ -392,17 +815,72 @@ int execute(comd *pipeline, int npipes) {
         
         //TODO TODO
         //*cur->cmd = resolvealiases(*cur->cmd);
+        res[i].name = *cur->cmd;
         
-        /**** try to execute cur as a built_in ****/
-        if ((status = exec_built_in(cur, stdinfd, stdoutfd)) != -1) {
-            printdebug("built-in: executed '%s'", *cur->cmd);
+        /**** a built-in or function in a pipeline runs in a forked subshell, so all stages stream concurrently ****/
+        int index;
+        struct function *func = NULL;
+        if (npipes > 0 && ((index = is_built_in(cur)) != -1 || (func = func_lookup(*cur->cmd)))) {
+            fflush(NULL);   // don't duplicate buffered output in the subshell
+            pid_t pid = fork();
+            if (pid == -1) {
+                printerrno("Creation of child process failed. Exiting");
+                exit(EXIT_FAILURE);
+            }
+            else if (pid == 0) {
+                // ######## subshell: redirect streams, setup pipe and run the built-in ########
+                printdebug("fork: now executing %s '%s'", func ? "function" : "built-in", *cur->cmd);
+                I_AM_FORK = 1;
+                signal(SIGINT, SIG_DFL);
+                jobs_subshell();
+                redirectstreams(cur, stdinfd, stdoutfd);
+                CLOSE_ALL_PIPES;
+                exit(func ? func_call(func, cur) : parse_built_in(cur, index));
+            }
+            res[i].pid = pid;
+            nbchildren++;
             CLOSE_PREV_PIPE
             continue;
         }
 
-        /**** cur is not a built-in; fork a child process ****/
-        nbchildren++;
+        /**** try to execute a sole cmd as a built_in, else as a function ****/
+        if (timed)
+            getrusage(RUSAGE_SELF, &before);
+        if ((res[i].status = exec_built_in(cur, stdinfd, stdoutfd)) != -1 ||
+                (res[i].status = exec_function(cur, stdinfd, stdoutfd)) != -1) {
+            printdebug("executed '%s' in jsh", *cur->cmd);
+            if (timed) {
+                // a built-in runs in jsh itself: record the resources jsh used meanwhile
+                getrusage(RUSAGE_SELF, &res[i].ru);
+                res[i].ru.ru_utime.tv_sec -= before.ru_utime.tv_sec;
+                res[i].ru.ru_utime.tv_usec -= before.ru_utime.tv_usec;
+                res[i].ru.ru_stime.tv_sec -= before.ru_stime.tv_sec;
+                res[i].ru.ru_stime.tv_usec -= before.ru_stime.tv_usec;
+                res[i].ru.ru_nvcsw -= before.ru_nvcsw;
+                res[i].ru.ru_nivcsw -= before.ru_nivcsw;
+                res[i].wall = clock_seconds() - start;
+            }
+            CLOSE_PREV_PIPE
+            continue;
+        }
+
+        /**** cur is not a built-in; spawn a child process iff possible ****/
+        if (USE_SPAWN) {
+            if ((res[i].pid = spawncmd(cur, stdinfd, stdoutfd, pfds, npipes*2)) == -1) {
+                res[i].pid = 0;
+                res[i].status = EXIT_FAILURE;   // as if the child exited with EXIT_FAILURE
+            }
+            else
+                nbchildren++;
+            CLOSE_PREV_PIPE
+            continue;
+        }
+
+        /**** else fork a child process ****/
+        const char *path = path_lookup(*cur->cmd);
         pid_t pid = fork();
+        res[i].pid = pid;
+        nbchildren++;
         if (pid == -1) {
             printerrno("Creation of child process failed. Exiting");
             exit(EXIT_FAILURE);
@@ -414,7 +892,9 @@ int execute(comd *pipeline, int npipes) {
             
             redirectstreams(cur, stdinfd, stdoutfd);
             CLOSE_ALL_PIPES; // no longer needed
-            // TODO use exevp to auto search for the cmd, using the PATH env
+            // execute the cached path directly; iff it's gone since, search $PATH
+            if (path)
+                execv(path, cur->cmd);
             if (execvp(*cur->cmd, cur->cmd) < 0) {
                 printerrno("couldn't execute command '%s'", *cur->cmd); //TODO here no color since !(is_interactive)...
                 exit(EXIT_FAILURE);
@@ -426,21 +906,44 @@ int execute(comd *pipeline, int npipes) {
     // ######## continued parent process execution: wait for children completion ########
     CLOSE_ALL_PIPES; // close all remaining open pipe fds; no longer needed
 
-    // wait for children completion
+    /* wait for children completion; only for our own children, not for background jobs.
+        NOTE: the children are reaped in the order they complete, so a stage's completion time is
+        recorded accurately even when a later stage finishes first (e.g. 'sleep 1 | true')  */
     WAITING_FOR_CHILD = true;
-    int statuschild = 0;
-    for (k = 0; k < nbchildren; k++) {
-        wait(&statuschild);
-        printdebug("waiting completed: child %d of %d", k+1, nbchildren);
+    while (nbchildren > 0) {
+        for (k = 0; k <= npipes; k++)
+            if (res[k].pid > 0 && reap_stage(&res[k], WNOHANG, start))
+                nbchildren--;
+        if (nbchildren > 0 && !jobs_sigchld_wait()) {
+            // no SIGCHLD notifications: block on the first remaining child
+            for (k = 0; res[k].pid <= 0; k++)
+                ;
+            if (reap_stage(&res[k], 0, start))
+                nbchildren--;
+        }
     }
     WAITING_FOR_CHILD = false;
-    
-    // free() the comd list
-    freecomdlist(pipeline);
-    
-    // return status of last process in the pipeline
-    status = ((status == -1)? statuschild: status);
-    return ((WIFEXITED(status)? WEXITSTATUS(status): WTERMSIG(status))); //TODO WIFSTOPPED
+
+    // keep the stage statuses for the 'pipestatus' built-in
+    if (last_pipeline.size < (size_t) npipes+1) {
+        last_pipeline.size = npipes+1;
+        if (!(last_pipeline.status = realloc(last_pipeline.status, sizeof(int) * last_pipeline.size))) {
+            printerrno("Couldn't allocate the pipeline status array");
+            exit(EXIT_FAILURE);
+        }
+    }
+    last_pipeline.nb = npipes+1;
+    for (k = 0; k <= npipes; k++)
+        last_pipeline.status[k] = res[k].status;
+
+    // return status of last process in the pipeline, or of the rightmost failed one iff PIPEFAIL
+    status = res[npipes].status;
+    for (k = npipes; PIPEFAIL && k >= 0; k--)
+        if (res[k].status != EXIT_SUCCESS) {
+            status = res[k].status;
+            break;
+        }
+    return status; //TODO WIFSTOPPED
     
     /*int rv;
     if ( WIFSIGNALED(status) ) {
@@ -462,6 +965,202 @@ int execute(comd *pipeline, int npipes) {
     */
 }
 
+/*
+ * reap_stage: waits for the child process of the provided stage with the provided waitpid()
+ *  options and records its exit status and resource usage. returns whether or not the
+ *  child was reaped
+ * @arg start: the start time of the pipeline, to record the stage's wall clock time
+ */
+bool reap_stage(struct stage_result *stage, int options, double start) {
+    int status;
+    pid_t pid;
+    while ((pid = wait4(stage->pid, &status, options, &stage->ru)) == -1 && errno == EINTR)
+        ;
+    if (pid == 0)
+        return false;
+    if (pid == -1)
+        printerrno("couldn't wait for child %d", stage->pid);
+    else
+        stage->status = WAIT_STATUS(status);
+    printdebug("waiting completed: child %d", stage->pid);
+    stage->pid = 0;
+    stage->wall = clock_seconds() - start;
+    return true;
+}
+
+/*
+ * start_timer: returns a new timer for a pipeline prefixed with 'time', allocated in the
+ *  line_arena, holding the current time and resource usage
+ */
+struct pipeline_timer *start_timer(void) {
+    struct pipeline_timer *timer = arena_calloc(&line_arena, sizeof(struct pipeline_timer));
+    getrusage(RUSAGE_SELF, &timer->self);
+    getrusage(RUSAGE_CHILDREN, &timer->children);
+    timer->start = clock_seconds();
+    return timer;
+}
+
+/*
+ * print_times: prints the resources used by the provided timed pipeline on stderr: a line for
+ *  each stage iff it was executed, and a total line for jsh and all children it waited for
+ */
+void print_times(struct node *pipeline, struct pipeline_timer *timer, int status) {
+    double real = clock_seconds() - timer->start;
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    long maxrss = 0;
+    size_t i;
+
+    fprintf(stderr, "%-16s %6s %9s %9s %9s %11s %8s %8s\n", "stage", "status", "real", "user", "sys",
+        "maxrss", "vcsw", "ivcsw");
+    for (i = 0; timer->res && i < timer->nb; i++) {
+        struct stage_result *r = &timer->res[i];
+        const char *name = (pipeline->kids[i]->type == NODE_GROUP) ? "(group)" : r->name;
+        fprintf(stderr, "%-16.16s %6d %8.3fs %8.3fs %8.3fs %8ldKiB %8ld %8ld\n", name, r->status, r->wall,
+            tv_seconds(r->ru.ru_utime), tv_seconds(r->ru.ru_stime), r->ru.ru_maxrss,
+            r->ru.ru_nvcsw, r->ru.ru_nivcsw);
+        if (r->ru.ru_maxrss > maxrss)
+            maxrss = r->ru.ru_maxrss;
+    }
+    double user = tv_seconds(self.ru_utime) - tv_seconds(timer->self.ru_utime) +
+        tv_seconds(children.ru_utime) - tv_seconds(timer->children.ru_utime);
+    double sys = tv_seconds(self.ru_stime) - tv_seconds(timer->self.ru_stime) +
+        tv_seconds(children.ru_stime) - tv_seconds(timer->children.ru_stime);
+    long vcsw = self.ru_nvcsw - timer->self.ru_nvcsw + children.ru_nvcsw - timer->children.ru_nvcsw;
+    long ivcsw = self.ru_nivcsw - timer->self.ru_nivcsw + children.ru_nivcsw - timer->children.ru_nivcsw;
+    if (maxrss)
+        fprintf(stderr, "%-16s %6d %8.3fs %8.3fs %8.3fs %8ldKiB %8ld %8ld\n", "total", status, real,
+            user, sys, maxrss, vcsw, ivcsw);
+    else
+        fprintf(stderr, "%-16s %6d %8.3fs %8.3fs %8.3fs %11s %8ld %8ld\n", "total", status, real,
+            user, sys, "-", vcsw, ivcsw);
+}
+
+void print_pipestatus(void) {
+    size_t i;
+    for (i = 0; i < last_pipeline.nb; i++)
+        printf("%s%d", i ? " " : "", last_pipeline.status[i]);
+    if (last_pipeline.nb)
+        printf("\n");
+}
+
+int set_pipe_size(const char *arg) {
+#ifdef F_SETPIPE_SZ
+    char *end;
+    long size = strtol(arg, &end, 10), max = 0;
+    if (*end == 'k' || *end == 'K')
+        size *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        size *= 1024 * 1024, end++;
+    if (*end != '\0' || size < 0 || size > INT_MAX) {
+        printerr("set: invalid pipe size '%s' (expected bytes, with an optional 'k' or 'm' suffix)", arg);
+        return EXIT_FAILURE;
+    }
+    FILE *f = fopen(PIPE_MAX_SIZE_FILE, "r");
+    if (f) {
+        if (fscanf(f, "%ld", &max) == 1 && max > 0 && size > max) {
+            printinfo("pipe size capped at %ld bytes (see %s)", max, PIPE_MAX_SIZE_FILE);
+            size = max;
+        }
+        fclose(f);
+    }
+    PIPE_SIZE = size;
+    printdebug("setting PIPE_SIZE to %d", PIPE_SIZE);
+    return EXIT_SUCCESS;
+#else
+    printerr("set: setting the pipe size isn't supported on this platform");
+    return EXIT_FAILURE;
+#endif
+}
+
+/*
+ * resize_pipe: sets the capacity of the provided pipe to PIPE_SIZE bytes. The kernel rounds
+ *  it up to a power of two pages; on failure (e.g. the user's pipe buffer quota is used up),
+ *  the pipe keeps its default capacity.
+ */
+void resize_pipe(int fd) {
+#ifdef F_SETPIPE_SZ
+    if (fcntl(fd, F_SETPIPE_SZ, PIPE_SIZE) == -1)
+        printdebug("couldn't set the pipe capacity to %d bytes: %s", PIPE_SIZE, strerror(errno));
+#endif
+}
+
+/*
+ * clock_seconds: returns the current monotonic clock time in seconds
+ */
+double clock_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * tv_seconds: returns the provided timeval in seconds
+ */
+double tv_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * spawncmd: starts the provided external cmd with posix_spawn(), which doesn't copy the shell's
+ *  page tables (e.g. vfork() semantics on Linux) so its cost doesn't grow with jsh's heap. The
+ *  redirection files are opened by jsh itself and wired, together with the provided pipe ends,
+ *  with file actions in the child. The executable is looked up in the cmd path hash table
+ *  (jsh-path.c), so the child needs a single execve(). All pipe fds in pfds[0, nfds) that aren't -1 are closed in
+ *  the child. returns the pid of the child, or -1 after printing an error message
+ */
+pid_t spawncmd(comd *cmd, int stdinfd, int stdoutfd, int *pfds, int nfds) {
+    const char *files[] = {cmd->inf, cmd->outf, cmd->errf};
+    int flags[] = {O_RDONLY, O_WRONLY | O_CREAT | (cmd->append_out ? O_APPEND : O_TRUNC),
+        O_WRONLY | O_CREAT | O_TRUNC};
+    int fds[] = {-1, -1, -1}, k, rv;
+    pid_t pid = -1;
+
+    // the same order and error messages as redirectstreams()
+    for (k = STDIN_FILENO; k <= STDERR_FILENO; k++)
+        if (files[k] && (fds[k] = open(files[k], flags[k] | O_CLOEXEC, 0666)) < 0) {
+            printerrno("error opening file '%s'", files[k]);
+            goto out;
+        }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    for (k = STDIN_FILENO; k <= STDERR_FILENO; k++)
+        if (fds[k] != -1)
+            posix_spawn_file_actions_adddup2(&actions, fds[k], k);
+    // piping has priority: override prev redirections if any
+    if (stdinfd != -1)
+        posix_spawn_file_actions_adddup2(&actions, stdinfd, STDIN_FILENO);
+    if (stdoutfd != -1)
+        posix_spawn_file_actions_adddup2(&actions, stdoutfd, STDOUT_FILENO);
+    for (k = 0; k < nfds; k++)
+        if (pfds[k] != -1)
+            posix_spawn_file_actions_addclose(&actions, pfds[k]);
+
+    // spawn the cached path directly; iff it's gone since, resolve the cmd once more
+    const char *path = path_lookup(*cmd->cmd);
+    printdebug("spawn: now executing '%s'", path ? path : *cmd->cmd);
+    rv = path ? posix_spawn(&pid, path, &actions, NULL, cmd->cmd, environ) : ENOENT;
+    if (rv == ENOENT && path && path != *cmd->cmd) {
+        path_forget(*cmd->cmd);
+        if ((path = path_lookup(*cmd->cmd)))
+            rv = posix_spawn(&pid, path, &actions, NULL, cmd->cmd, environ);
+    }
+    if (rv != 0) {
+        errno = rv;
+        printerrno("couldn't execute command '%s'", *cmd->cmd);
+        pid = -1;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+
+out:
+    for (k = STDIN_FILENO; k <= STDERR_FILENO; k++)
+        if (fds[k] != -1)
+            close(fds[k]);
+    return pid;
+}
+
 /*
  * exec_built_in: try to execute the provided *comd as a built_in shell command;
  *  wrapper for parse_built_in(), redirecting and restoring std streams if needed
@@ -487,6 +1186,33 @@ int exec_built_in(comd *comd, int stdinfd, int stdoutfd) {
     return rv;
 }
 
+/*
+ * exec_function: if the provided comd is a shell function, calls it in jsh itself with the
+ *  provided pipe fds and the comd's redirections, and returns its exit status; else returns -1
+ */
+int exec_function(comd *comd, int stdinfd, int stdoutfd) {
+    struct function *func = func_lookup(*comd->cmd);
+    if (!func)
+        return -1;
+
+    // the body's cmds inherit the redirected std streams; restore them afterwards
+    int saved_stdin = dup(STDIN_FILENO);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    fflush(NULL);
+    redirectstreams(comd, stdinfd, stdoutfd);
+    int rv = func_call(func, comd);
+    fflush(NULL);
+    REDIRECT_STR(saved_stdin, STDIN_FILENO);
+    REDIRECT_STR(saved_stdout, STDOUT_FILENO);
+    REDIRECT_STR(saved_stderr, STDERR_FILENO);
+    close(saved_stdin);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    return rv;
+}
+
 /*
  * redirectstreams: redirect stdin, stdout, stderr as specified in the specified comd struct and 
  *  stdinfd/stdoutfd arguments: specifying the file descriptors for the pipeline if any; else -1
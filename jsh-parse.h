@@ -22,6 +22,9 @@
 /* ^^ these are the include guards */
 
 #include "jsh-common.h"
+#include "jsh-lex.h"
+#include "jsh-arena.h"
+#include "jsh-path.h"
 #include "alias.h"
 
 struct comd {
@@ -35,17 +38,106 @@ struct comd {
 };
 typedef struct comd comd;
 
-/**
- * TODO also take aliases etc into account
+extern struct arena line_arena;     // holds the parse and execution state of the current line
+extern int MAX_DEPTH;               // the max nesting depth of groups accepted by parse()
+extern bool USE_SPAWN;              // whether external cmds are started with posix_spawn instead of fork
+extern bool PIPEFAIL;               // whether a pipeline fails iff any stage fails, instead of the last one
+extern int PIPE_SIZE;               // the capacity of the pipes between pipeline stages in bytes; 0 for the default
+
+enum node_type {NODE_LIST, NODE_AND_OR, NODE_PIPELINE, NODE_GROUP, NODE_COMMAND, NODE_FUNCTION};
+
+/*
+ * a node in the abstract syntax tree of a parsed line; the tree isn't modified by evaluate()
+ */
+struct node {
+    enum node_type type;
+    struct node **kids; // LIST, AND_OR, PIPELINE: the list items; GROUP, FUNCTION: kids[0] is the body list
+    size_t nb;          // the number of kids
+    enum token_type *ops;   // AND_OR only: ops[i] (TOK_AND || TOK_OR) joins kids[i] and kids[i+1]
+    char **argv;        // COMMAND: NULL-terminated array of the command's name and its arguments; FUNCTION: the name
+    int argc;           // COMMAND, FUNCTION: the length of the argv array
+    bool *params;       // COMMAND only: which argv words refer to positional parameters, or NULL iff none
+    char *inf;          // GROUP, COMMAND: name of the file for redirecting stdin or NULL
+    char *outf;         // GROUP, COMMAND: name of the file for redirecting stdout or NULL
+    char *errf;         // GROUP, COMMAND: name of the file for redirecting stderr or NULL
+    int append_out;     // GROUP, COMMAND: whether or not stdout should append to the file
+    bool background;    // list items only: whether or not the item is followed by '&'
+    char *text;         // background list items: the source text of the item; FUNCTION: the body's source text
+    bool timed;         // PIPELINE only: whether or not the pipeline is prefixed with 'time'
+};
+
+/*
+ * a parsed line: the root list node and the token stream holding all words it points to
  */
-int parse_from_file(char *line);
+typedef struct ast {
+    struct node *root;
+    struct tokens tokens;
+} ast;
 
 /*
- * parseexpr: parses the '\0' terminated expr string recursivly, according to the 'expr' grammar.
- * returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of executed expression
+ * parseexpr: expands the aliases in the '\0' terminated expr string, parses it according to the
+ *  'input' grammar and evaluates it. A repeated expr isn't expanded and parsed again, but taken
+ *  from the parse cache (see jsh-cache.h). returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS)
+ *  of executed expression
  */
 int parseexpr(char*);
 
+/*
+ * parse: returns a syntax tree for the provided line, in time linear in the length of the line.
+ *  Returns NULL after printing an error message iff the line doesn't match the grammar or
+ *  nests groups deeper than MAX_DEPTH.
+ * @arg a: the arena to allocate the tree in; release it after use
+ * @arg incomplete: iff not NULL, a line ending in an unclosed function body isn't reported as
+ *  an error, but returns NULL with *incomplete set, so it can be continued on the next line
+ */
+ast *parse(const char*, struct arena *a, bool *incomplete);
+
+/*
+ * parse_pending: returns whether or not the last expr passed to parseexpr() ended in an unclosed
+ *  function body; the next expr is then appended to it, on a new line
+ */
+bool parse_pending(void);
+
+/*
+ * parse_end_input: reports and discards the unclosed function definition passed to parseexpr(),
+ *  if any. Should be called at the end of every input source, e.g. a sourced file.
+ */
+void parse_end_input(const char *source);
+
+/*
+ * parse_discard_input: discards the unclosed function definition passed to parseexpr(), if any,
+ *  without an error message; e.g. when the input line is cancelled with ^C
+ */
+void parse_discard_input(void);
+
+/*
+ * evaluate: evaluates the provided syntax tree node, without modifying it. Uses a heap allocated
+ *  work stack instead of recursion, so deep trees and long chains can't overflow the C stack.
+ *  returns exit status (EXIT_SUCCESS || !EXIT_SUCCESS) of the evaluated node
+ */
+int evaluate(struct node*);
+
+/*
+ * spawncmd: starts the provided external cmd with posix_spawn(), with its redirections and
+ *  the provided stdin and stdout fds (iff not -1), and without waiting for it. The fds in
+ *  pfds[0, nfds) that aren't -1 are closed in the child. returns the child's pid, or -1 after
+ *  printing an error message
+ */
+pid_t spawncmd(comd*, int, int, int*, int);
+
+/*
+ * set_pipe_size: sets PIPE_SIZE to the provided nb of bytes, with an optional 'k' or 'm'
+ *  suffix ('0' for the system default), capped at the max pipe size of the system.
+ *  returns EXIT_SUCCESS iff the size is valid and pipes can be resized on this platform
+ */
+int set_pipe_size(const char*);
+
+/*
+ * print_pipestatus: prints the exit status of each stage of the last executed pipeline on
+ *  stdout, separated by spaces
+ */
+void print_pipestatus(void);
+
 /* 
  * is_valid_cmd: returns whether or not an occurence of a cmd string is valid in a given 
  *  context string. An cmd is valid iff it occurs as a comd in the grammar.
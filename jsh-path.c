@@ -0,0 +1,524 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * ----------------------------------------------------------------------
+ * jsh-path.c: a hash table from cmd names to the executables they resolve to in $PATH, so an
+ *  external cmd is started with a single execve() instead of trying every $PATH entry in
+ *  turn. Not-found results are cached too; they are re-resolved when a $PATH directory was
+ *  modified since, so a newly installed cmd is found without 'hash -r'.
+ *  Also keeps a sorted catalog of the names of all executables in the $PATH dirs for cmd
+ *  completion; it's built by a background thread at startup (or else on first use) by
+ *  reading the dirs' entries (with getdents64 on Linux), and rebuilt when $PATH or the mtime
+ *  of any of its dirs changes.
+ * ----------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE     // fstatat(), dirfd() and syscall() on Linux
+#include "jsh-path.h"
+#include "jsh-arena.h"
+#include <time.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+#ifdef __linux__
+    #include <sys/syscall.h>
+    #define HAVE_GETDENTS64
+#endif
+
+#define PATH_INIT_BUCKETS       64      // initial nb of buckets; always a power of two
+#define DEFAULT_PATH            "/usr/local/bin:/usr/bin:/bin"  // execvp's default iff $PATH is unset
+#define CATALOG_CHUNK_SIZE      (64 * 1024)     // arena chunk size for the catalog's names
+#define CATALOG_MIN_SIZE        1024            // initial capacity of the catalog's name array
+#define DENTS_BUF_SIZE          (32 * 1024)     // buffer size for a getdents64() call
+
+struct path_entry {
+    char *cmd;
+    char *path;                 // the resolved absolute path or NULL iff not found
+    time_t resolved;            // when the entry was resolved
+    unsigned long hits;
+    struct path_entry *next;    // the next entry in the same bucket
+};
+
+struct {
+    struct path_entry **buckets;
+    size_t nb_buckets;
+    size_t nb_entries;
+    char *path_env;             // the $PATH value the entries were resolved against
+    unsigned long hits;
+    unsigned long misses;
+} path_cache = {NULL, 0, 0, NULL, 0, 0};
+
+/*
+ * the names of all executables in the absolute $PATH dirs, sorted and without duplicates
+ */
+struct {
+    char **names;
+    size_t nb;
+    size_t cap;
+    struct arena arena;         // holds the names
+    char *path_env;             // the $PATH value the catalog was built from, or NULL iff not built
+    struct timespec *mtimes;    // the mtime of each $PATH dir when it was read; 0 iff not found
+    size_t nb_dirs;
+    pthread_t worker;           // the thread building the catalog iff prefetching
+    bool prefetching;           // the catalog may only be used after joining the worker
+} catalog = {NULL, 0, 0, {NULL, NULL, 0, 0, 0, 0, 0, CATALOG_CHUNK_SIZE}, NULL, NULL, 0};
+
+#ifdef HAVE_GETDENTS64
+/*
+ * a directory entry as returned by the Linux getdents64 system call
+ */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+// #################### helper function definitions ####################
+const char *path_env(void);
+char *resolve(const char*, bool*);
+bool path_dirs_modified_since(time_t);
+void grow_buckets(void);
+void free_entry(struct path_entry*);
+bool catalog_stale(void);
+void catalog_build(char*);
+void *catalog_worker(void*);
+void catalog_join(void);
+void catalog_flush(void);
+size_t catalog_read_dir(const char*, struct timespec*);
+void catalog_add(int, const char*, unsigned char);
+size_t catalog_bound(const char*, size_t, bool);
+
+const char *path_lookup(const char *cmd) {
+    if (strchr(cmd, '/'))
+        return cmd;
+
+    // drop all entries when $PATH changed since they were resolved
+    const char *env = path_env();
+    if (!path_cache.path_env || strcmp(env, path_cache.path_env) != 0) {
+        path_flush();
+        path_cache.path_env = strclone(env);
+    }
+    if (!path_cache.buckets) {
+        path_cache.nb_buckets = PATH_INIT_BUCKETS;
+        path_cache.buckets = calloc(path_cache.nb_buckets, sizeof(struct path_entry*));
+    }
+
+    struct path_entry **b = &path_cache.buckets[hash_string(cmd) & (path_cache.nb_buckets - 1)];
+    struct path_entry *e;
+    for (e = *b; e; e = e->next)
+        if (strcmp(e->cmd, cmd) == 0)
+            break;
+    if (e && (e->path || !path_dirs_modified_since(e->resolved))) {
+        path_cache.hits++;
+        e->hits++;
+        return e->path;
+    }
+
+    /**** a miss: search $PATH ****/
+    path_cache.misses++;
+    bool cacheable;
+    char *path = resolve(cmd, &cacheable);
+    printdebug("hash: resolved '%s' to '%s'", cmd, path ? path : "(not found)");
+    if (!cacheable) {
+        // resolved in a relative $PATH dir: depends on the cwd; keep it until the next lookup
+        if (e)
+            path_forget(cmd);
+        static char *uncached = NULL;
+        free(uncached);
+        return (uncached = path);
+    }
+    if (e) {
+        // a stale not-found entry
+        e->path = path;
+        e->resolved = time(NULL);
+        return path;
+    }
+    e = malloc(sizeof(struct path_entry));
+    *e = (struct path_entry) {strclone(cmd), path, time(NULL), 0, *b};
+    *b = e;
+    if (++path_cache.nb_entries > path_cache.nb_buckets)
+        grow_buckets();
+    return path;
+}
+
+void path_forget(const char *cmd) {
+    if (!path_cache.buckets)
+        return;
+    struct path_entry **e = &path_cache.buckets[hash_string(cmd) & (path_cache.nb_buckets - 1)];
+    for (; *e; e = &(*e)->next)
+        if (strcmp((*e)->cmd, cmd) == 0) {
+            struct path_entry *old = *e;
+            *e = old->next;
+            free_entry(old);
+            path_cache.nb_entries--;
+            return;
+        }
+}
+
+void path_flush(void) {
+    size_t i;
+    for (i = 0; i < path_cache.nb_buckets; i++)
+        while (path_cache.buckets[i]) {
+            struct path_entry *old = path_cache.buckets[i];
+            path_cache.buckets[i] = old->next;
+            free_entry(old);
+        }
+    path_cache.nb_entries = 0;
+    free(path_cache.path_env);
+    path_cache.path_env = NULL;
+}
+
+void path_print(void) {
+    size_t i;
+    struct path_entry *e;
+    printf("%-8s %-20s %s\n", "hits", "command", "path");
+    for (i = 0; i < path_cache.nb_buckets; i++)
+        for (e = path_cache.buckets[i]; e; e = e->next)
+            printf("%-8lu %-20s %s\n", e->hits, e->cmd, e->path ? e->path : "(not found)");
+    printf("%lu hits, %lu misses, %zu entries\n", path_cache.hits, path_cache.misses, path_cache.nb_entries);
+}
+
+void path_catalog_prefetch(void) {
+    sigset_t all, old;
+    char *env = strclone(path_env());   // getenv() isn't safe against a concurrent setenv()
+
+    // block all signals in the worker: e.g. the SIGINT handler siglongjmp()s to the main loop
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    catalog_flush();
+    if (pthread_create(&catalog.worker, NULL, catalog_worker, env) == 0)
+        catalog.prefetching = true;
+    else {
+        printdebug("hash: couldn't start the catalog worker: %s", strerror(errno));
+        free(env);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+size_t path_catalog_range(const char *prefix, size_t *nb) {
+    catalog_join();
+    if (catalog_stale()) {
+        catalog_flush();
+        catalog_build(strclone(path_env()));
+    }
+    size_t len = strlen(prefix);
+    size_t first = catalog_bound(prefix, len, false);
+    *nb = catalog_bound(prefix, len, true) - first;
+    return first;
+}
+
+const char *path_catalog_name(size_t i) {
+    return (i < catalog.nb) ? catalog.names[i] : NULL;
+}
+
+/*
+ * path_env: returns the current value of $PATH, or the default search path iff unset
+ */
+const char *path_env(void) {
+    const char *env = getenv("PATH");
+    return env ? env : DEFAULT_PATH;
+}
+
+/*
+ * resolve: returns a newly malloced path of the first executable regular file named cmd in
+ *  the $PATH dirs, or NULL iff there is none. Sets *cacheable to false iff the result depends
+ *  on the cwd, i.e. a relative dir was searched before the cmd was found.
+ */
+char *resolve(const char *cmd, bool *cacheable) {
+    const char *dir = path_env(), *end;
+    size_t cmdlen = strlen(cmd);
+    *cacheable = true;
+    for (; ; dir = end + 1) {
+        end = strchr(dir, ':');
+        if (!end)
+            end = dir + strlen(dir);
+
+        // an empty entry is the cwd
+        size_t dirlen = end - dir;
+        if (dirlen == 0 || *dir != '/')
+            *cacheable = false;
+        char *path = malloc(dirlen + cmdlen + 3);
+        if (dirlen == 0)
+            path[dirlen++] = '.';
+        else
+            memcpy(path, dir, dirlen);
+        path[dirlen] = '/';
+        memcpy(path + dirlen + 1, cmd, cmdlen + 1);
+
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0)
+            return path;
+        free(path);
+        if (*end == '\0')
+            return NULL;
+    }
+}
+
+/*
+ * path_dirs_modified_since: returns whether or not any of the $PATH dirs was modified at or
+ *  after the provided time, i.e. a cmd may have been added to it
+ */
+bool path_dirs_modified_since(time_t t) {
+    const char *dir = path_env(), *end;
+    char buf[PATH_MAX];
+    for (; ; dir = end + 1) {
+        end = strchr(dir, ':');
+        if (!end)
+            end = dir + strlen(dir);
+        size_t dirlen = end - dir;
+        struct stat st;
+        if (dirlen > 0 && dirlen < PATH_MAX) {
+            memcpy(buf, dir, dirlen);
+            buf[dirlen] = '\0';
+            if (stat(buf, &st) == 0 && st.st_mtime >= t)
+                return true;
+        }
+        if (*end == '\0')
+            return false;
+    }
+}
+
+/*
+ * grow_buckets: doubles the nb of buckets and rehashes all entries
+ */
+void grow_buckets(void) {
+    size_t i, nb = path_cache.nb_buckets * 2;
+    struct path_entry **buckets = calloc(nb, sizeof(struct path_entry*));
+    for (i = 0; i < path_cache.nb_buckets; i++)
+        while (path_cache.buckets[i]) {
+            struct path_entry *e = path_cache.buckets[i];
+            path_cache.buckets[i] = e->next;
+            e->next = buckets[hash_string(e->cmd) & (nb - 1)];
+            buckets[hash_string(e->cmd) & (nb - 1)] = e;
+        }
+    free(path_cache.buckets);
+    path_cache.buckets = buckets;
+    path_cache.nb_buckets = nb;
+}
+
+void free_entry(struct path_entry *e) {
+    free(e->cmd);
+    free(e->path);
+    free(e);
+}
+
+/*
+ * catalog_stale: returns whether or not the catalog needs to be (re)built, i.e. it wasn't built
+ *  yet, $PATH changed or any of its dirs was modified (or created or removed) since it was read
+ */
+bool catalog_stale(void) {
+    const char *dir = path_env(), *end;
+    if (!catalog.path_env || strcmp(dir, catalog.path_env) != 0)
+        return true;
+    char buf[PATH_MAX];
+    size_t i = 0;
+    for (; ; dir = end + 1) {
+        end = strchr(dir, ':');
+        if (!end)
+            end = dir + strlen(dir);
+        size_t dirlen = end - dir;
+        if (dirlen > 0 && dirlen < PATH_MAX && *dir == '/') {
+            memcpy(buf, dir, dirlen);
+            buf[dirlen] = '\0';
+            struct stat st;
+            struct timespec mtime = {0, 0};
+            if (stat(buf, &st) == 0)
+                mtime = ST_MTIM(st);
+            if (mtime.tv_sec != catalog.mtimes[i].tv_sec || mtime.tv_nsec != catalog.mtimes[i].tv_nsec)
+                return true;
+            i++;
+        }
+        if (*end == '\0')
+            return false;
+    }
+}
+
+/*
+ * catalog_build: builds the empty catalog from the absolute dirs in the provided malloced
+ *  $PATH value, which is owned by the catalog afterwards. Relative dirs are skipped, as their
+ *  content depends on the cwd.
+ */
+void catalog_build(char *env) {
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const char *dir, *end;
+    size_t nb_dirs = 1;
+    for (dir = env; *dir; dir++)
+        nb_dirs += (*dir == ':');
+    if (!(catalog.mtimes = calloc(nb_dirs, sizeof(struct timespec)))) {
+        // left unbuilt: retried on the next use
+        printerrno("hash: calloc");
+        free(env);
+        return;
+    }
+    catalog.path_env = env;
+
+    char buf[PATH_MAX];
+    size_t nb_entries = 0;
+    for (dir = env; ; dir = end + 1) {
+        end = strchr(dir, ':');
+        if (!end)
+            end = dir + strlen(dir);
+        size_t dirlen = end - dir;
+        if (dirlen > 0 && dirlen < PATH_MAX && *dir == '/') {
+            memcpy(buf, dir, dirlen);
+            buf[dirlen] = '\0';
+            nb_entries += catalog_read_dir(buf, &catalog.mtimes[catalog.nb_dirs++]);
+        }
+        if (*end == '\0')
+            break;
+    }
+
+    // sort the names and drop the ones shadowed by an earlier $PATH dir
+    qsort(catalog.names, catalog.nb, sizeof(char*), string_cmp);
+    size_t i, nb = 0;
+    for (i = 0; i < catalog.nb; i++)
+        if (nb == 0 || strcmp(catalog.names[nb - 1], catalog.names[i]) != 0)
+            catalog.names[nb++] = catalog.names[i];
+    catalog.nb = nb;
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    printdebug("hash: cataloged %zu executables out of %zu entries in %zu dirs in %.3f ms",
+        catalog.nb, nb_entries, catalog.nb_dirs, (stop.tv_sec - start.tv_sec) * 1e3 + (stop.tv_nsec - start.tv_nsec) / 1e6);
+}
+
+/*
+ * catalog_worker: the start routine of the thread prefetching the catalog
+ */
+void *catalog_worker(void *env) {
+    IS_BACKGROUND_THREAD = true;
+    catalog_build(env);
+    return NULL;
+}
+
+/*
+ * catalog_join: waits for the thread prefetching the catalog to finish, if any
+ */
+void catalog_join(void) {
+    if (catalog.prefetching) {
+        pthread_join(catalog.worker, NULL);
+        catalog.prefetching = false;
+    }
+}
+
+/*
+ * catalog_flush: drops the catalog, so it's rebuilt on its next use
+ */
+void catalog_flush(void) {
+    catalog_join();
+    arena_free(&catalog.arena);
+    free(catalog.names);
+    free(catalog.path_env);
+    free(catalog.mtimes);
+    catalog.names = NULL;
+    catalog.path_env = NULL;
+    catalog.mtimes = NULL;
+    catalog.nb = catalog.cap = catalog.nb_dirs = 0;
+}
+
+/*
+ * catalog_read_dir: adds the executables in the provided dir to the catalog and stores the
+ *  dir's mtime in *mtime (left 0 iff it can't be read). returns the nb of dir entries read.
+ *  The entries' types are taken from the dir itself, so only entries of an unknown type
+ *  need a stat.
+ */
+size_t catalog_read_dir(const char *path, struct timespec *mtime) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    *mtime = ST_MTIM(st);
+    size_t nb = 0;
+
+#ifdef HAVE_GETDENTS64
+    char buf[DENTS_BUF_SIZE];
+    long n, pos;
+    while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0)
+        for (pos = 0; pos < n; nb++) {
+            struct linux_dirent64 *d = (struct linux_dirent64*) (buf + pos);
+            catalog_add(fd, d->d_name, d->d_type);
+            pos += d->d_reclen;
+        }
+    if (n < 0)
+        printdebug("hash: getdents64 on '%s' failed: %s", path, strerror(errno));
+    close(fd);
+#else
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return 0;
+    }
+    struct dirent *e;
+    for (; (e = readdir(d)) != NULL; nb++)
+        catalog_add(dirfd(d), e->d_name, e->d_type);
+    closedir(d);    // also closes fd
+#endif
+    return nb;
+}
+
+/*
+ * catalog_add: adds the provided entry of the provided dir to the catalog iff it may be an
+ *  executable: symbolic links and regular files are trusted without a stat (execve() checks
+ *  the permissions anyway), entries of an unknown type are checked with fstatat()
+ */
+void catalog_add(int dir, const char *name, unsigned char type) {
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        return;
+    if (type != DT_REG && type != DT_LNK) {
+        if (type != DT_UNKNOWN)
+            return;
+        struct stat st;
+        if (fstatat(dir, name, &st, 0) != 0 || !S_ISREG(st.st_mode) || !(st.st_mode & 0111))
+            return;
+    }
+    if (catalog.nb == catalog.cap) {
+        catalog.cap = catalog.cap ? catalog.cap * 2 : CATALOG_MIN_SIZE;
+        catalog.names = realloc(catalog.names, sizeof(char*) * catalog.cap);
+        if (!catalog.names) {
+            printerrno("hash: realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    catalog.names[catalog.nb++] = arena_strdup(&catalog.arena, name);
+}
+
+/*
+ * catalog_bound: returns the index of the first catalog name whose first len chars are not
+ *  smaller than (upper: greater than) the provided name's
+ */
+size_t catalog_bound(const char *name, size_t len, bool upper) {
+    size_t lo = 0, hi = catalog.nb, mid;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        int cmp = strncmp(catalog.names[mid], name, len);
+        if (cmp < 0 || (upper && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
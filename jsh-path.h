@@ -0,0 +1,72 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_PATH_H_INCLUDED
+#define JSH_PATH_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+/*
+ * path_lookup: returns the absolute path of the executable the provided cmd name resolves to
+ *  in $PATH, or NULL iff there is none. Results, including not-found ones, are cached until
+ *  $PATH changes or path_flush() is called; a cmd containing a '/' is returned as is.
+ * @note: the returned string is owned by the cache and valid until the next path_* call
+ */
+const char *path_lookup(const char *cmd);
+
+/*
+ * path_forget: drops the cached entry for the provided cmd name, if any. Should be called
+ *  when the cached path turned out not to exist anymore (ENOENT).
+ */
+void path_forget(const char *cmd);
+
+/*
+ * path_flush: drops all cached entries
+ */
+void path_flush(void);
+
+/*
+ * path_print: prints the cached entries, with their nb of hits, and the cache hit/miss
+ *  counters on stdout
+ */
+void path_print(void);
+
+/*
+ * path_catalog_prefetch: starts building the catalog of all executables in the $PATH dirs in a
+ *  background thread, so it's ready by the time it's used
+ */
+void path_catalog_prefetch(void);
+
+/*
+ * path_catalog_range: returns the index of the first name in the catalog of all executables in
+ *  the $PATH dirs that starts with the provided prefix, and stores the nb of such names in
+ *  *nb; the matching names are path_catalog_name(index) to path_catalog_name(index + *nb - 1).
+ *  The sorted catalog is built on first use and rebuilt iff $PATH or any of its dirs changed.
+ */
+size_t path_catalog_range(const char *prefix, size_t *nb);
+
+/*
+ * path_catalog_name: returns the name at the specified index of the catalog, or NULL iff out
+ *  of range.
+ * @note: the returned string is owned by the catalog and only valid until the next path_* call
+ */
+const char *path_catalog_name(size_t i);
+
+#endif // JSH_PATH_H_INCLUDED
@@ -0,0 +1,720 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * jsh-prompt.c: prompt string expansion. Expanding the '%c', '%U' and '%$' options may
+ *  take long (git index scan, sudo fork), so when ASYNC_PROMPT is on these slow segments
+ *  are computed by a background worker thread:
+ *
+ *  1. getprompt() posts a request to the worker and immediately renders the prompt with
+ *     placeholders: the previous result when still meaningful, else a neutral value
+ *  2. readline draws the prompt and starts accepting keystrokes right away
+ *  3. readline's event hook, polled while waiting for input, re-renders the prompt once
+ *     the worker's result arrived and redraws the line iff the prompt changed
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-prompt.h"
+#include "jsh-colors.h"
+#include "jsh-git.h"
+#include "jsh-state.h"
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <readline/readline.h>
+
+#define MAX_PROMPT_BUF_LENGTH   50                  // the max number of msd of a status integer in the prompt string
+#define MAX_BRANCH_LENGTH       256                 // git branch names are truncated to this length
+#define PROMPT_REDRAW_INTERVAL  20000               // usecs between checks for arrived async segments
+
+#define DEFAULT_SUDO_TTL        60                  // max nb of seconds a cached sudo probe result is used
+#define SEG_PENDING             -2                  // a slow segment value that isn't computed yet
+#define SEG_DIRTY               0x1                 // async segment mask bits
+#define SEG_SUDO                0x2
+
+#define PROFILE_RENDERS         256                 // nb of most recent renders the profiler keeps samples of
+
+#ifdef NOASYNC_PROMPT
+    bool ASYNC_PROMPT = false;
+#else
+    bool ASYNC_PROMPT = true;
+#endif
+
+int MAX_DIR_LENGTH = 25;        // the maximum length of an expanded pwd substring in the prompt string
+int SUDO_TTL = DEFAULT_SUDO_TTL;
+bool PROFILE_PROMPT = false;
+
+/*
+ * a compiled prompt string: a list of literal spans and dynamic segment opcodes
+ */
+enum prompt_op {OP_LITERAL, OP_USER, OP_USER_SUDO, OP_SUDO_CHAR, OP_HOST, OP_STATUS,
+    OP_STATUS_COLOR, OP_DIR, OP_GIT_BRANCH, OP_GIT_DIRTY};
+
+struct prompt_segment {
+    enum prompt_op op;
+    size_t offset;              // OP_LITERAL only: the span prog->text[offset, offset+len)
+    size_t len;
+};
+
+struct prompt_program {
+    char *text;                 // all literal text and resolved color codes
+    struct prompt_segment *segs;
+    size_t nb_segs;
+    int async;                  // SEG_* mask of the slow segments in the program
+};
+
+struct prompt_program *prompt_program = NULL;   // initialized in things_todo_at_start function
+
+/*
+ * the prompt profiler: a ring buffer with the time spent per segment kind for the last
+ *  PROFILE_RENDERS renders. The slow segments are also timed in the background worker.
+ */
+enum {PROF_WORKER_DIRTY = OP_GIT_DIRTY + 1, PROF_WORKER_SUDO, NB_PROF_SLOTS};
+
+const char *prof_names[NB_PROF_SLOTS] = {"literals", "%u", "%U", "%$", "%h", "%s", "%S",
+    "%d", "%g", "%c", "%c worker", "sudo worker"};
+
+struct {
+    pthread_mutex_t lock;       // the worker records samples as well
+    long samples[NB_PROF_SLOTS][PROFILE_RENDERS];   // nanoseconds
+    unsigned long count[NB_PROF_SLOTS];             // nb of samples ever recorded
+} profile = {PTHREAD_MUTEX_INITIALIZER};
+
+/*
+ * the values of the slow prompt segments: git_is_dirty() and sudo_active() results
+ */
+struct prompt_values {
+    int dirty;
+    int sudo;
+};
+
+/*
+ * shared state between the main thread and the background worker, protected by lock
+ */
+struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // signaled on a new request and on request completion
+    bool started;               // whether or not the worker thread is running
+    bool pending;               // a request is waiting to be picked up by the worker
+    bool busy;                  // the worker is computing a request
+    unsigned int generation;    // generation of the last requested prompt
+    unsigned int done;          // generation of the last computed request
+    bool applied;               // the result of generation 'done' has been displayed
+    int segments;               // SEG_* mask of the last request
+    char *cwd;                  // cwd of the last request
+    char *result_cwd;           // cwd the last dirty result was computed for
+    struct prompt_values result;
+} async = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, false, false, 0, 0,
+    true, 0, NULL, NULL, {SEG_PENDING, SEG_PENDING}};
+
+int displayed_status = 0;       // status argument of the currently displayed prompt
+
+/*
+ * the privilege cache, shared by the '%U' and '%$' expansions in the main and worker thread:
+ *  sudo is slow (PAM) and logs every probe, so it is probed at most once per SUDO_TTL seconds
+ */
+struct {
+    pthread_mutex_t lock;
+    bool valid;
+    bool active;                // the cached sudo_probe() result
+    time_t checked;             // CLOCK_MONOTONIC time of the cached probe
+    unsigned long hits;
+    unsigned long misses;
+} privileges = {PTHREAD_MUTEX_INITIALIZER, false, false, 0, 0, 0};
+
+// #################### helper function definitions ####################
+struct prompt_program *prompt_compile(const char*);
+void prompt_free(struct prompt_program*);
+char *render_prompt(int, struct prompt_values*);
+struct prompt_values async_request(int);
+void *prompt_worker(void*);
+int prompt_event_hook(void);
+bool sudo_active(void);
+bool sudo_probe(void);
+long elapsed_ns(struct timespec*);
+void profile_record(int, long);
+int cmp_long(const void*, const void*);
+
+/*
+ * getprompt: return a string representing the command prompt (as defined by the current prompt string)
+ *  iff IS_INTERACTIVE, else the empty string is returned.
+ */
+char *getprompt(int status) {
+    struct prompt_values values = {SEG_PENDING, SEG_PENDING};
+    if (!IS_INTERACTIVE || !prompt_program)
+        return "";
+
+    displayed_status = status;
+    if (ASYNC_PROMPT && async.started && prompt_program->async)
+        values = async_request(prompt_program->async);
+    return render_prompt(status, &values);
+}
+
+/*
+ * prompt_init: starts the background prompt worker and installs the readline redisplay hook.
+ */
+void prompt_init(void) {
+    pthread_t worker;
+    sigset_t all, old;
+    if (!IS_INTERACTIVE)
+        return;
+
+    // block all signals in the worker: e.g. the SIGINT handler siglongjmp()s to the main loop
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    if (pthread_create(&worker, NULL, prompt_worker, NULL) == 0) {
+        pthread_detach(worker);
+        async.started = true;
+        rl_event_hook = prompt_event_hook;
+        rl_set_keyboard_input_timeout(PROMPT_REDRAW_INTERVAL);
+    }
+    else
+        printerr("prompt: couldn't start the async prompt worker: %s", strerror(errno));
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/*
+ * prompt_settle: blocks until the background worker finished its current request, if any.
+ */
+void prompt_settle(void) {
+    if (!async.started)
+        return;
+    pthread_mutex_lock(&async.lock);
+    while (async.pending || async.busy)
+        pthread_cond_wait(&async.cond, &async.lock);
+    pthread_mutex_unlock(&async.lock);
+}
+
+/*
+ * async_request: posts a request for the provided SEG_* mask to the worker and returns
+ *  placeholder values to render the prompt with until the result arrives
+ */
+struct prompt_values async_request(int segments) {
+    struct prompt_values rv;
+    char *cwd = strclone(state_cwd());
+
+    pthread_mutex_lock(&async.lock);
+    // the previous dirty state is only meaningful for the same directory
+    bool same_dir = cwd && async.result_cwd && strcmp(cwd, async.result_cwd) == 0;
+    rv.dirty = (same_dir && async.result.dirty != SEG_PENDING) ? async.result.dirty : 0;
+    rv.sudo = (async.result.sudo != SEG_PENDING) ? async.result.sudo : 0;
+
+    free(async.cwd);
+    async.cwd = cwd;
+    async.segments = segments;
+    async.generation++;
+    async.pending = true;
+    pthread_cond_broadcast(&async.cond);
+    pthread_mutex_unlock(&async.lock);
+    return rv;
+}
+
+/*
+ * prompt_worker: the background worker thread main loop, computing the requested slow
+ *  segments one request at a time
+ */
+void *prompt_worker(void *arg) {
+    IS_BACKGROUND_THREAD = true;
+    pthread_mutex_lock(&async.lock);
+    while (true) {
+        while (!async.pending)
+            pthread_cond_wait(&async.cond, &async.lock);
+        unsigned int generation = async.generation;
+        int segments = async.segments;
+        char *cwd = async.cwd ? strclone(async.cwd) : NULL;
+        async.pending = false;
+        async.busy = true;
+        pthread_mutex_unlock(&async.lock);
+
+        struct timespec start;
+        int dirty = SEG_PENDING, sudo = SEG_PENDING;
+        if (segments & SEG_DIRTY) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            dirty = git_is_dirty(cwd);
+            if (PROFILE_PROMPT)
+                profile_record(PROF_WORKER_DIRTY, elapsed_ns(&start));
+        }
+        if (segments & SEG_SUDO) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            sudo = sudo_active();
+            if (PROFILE_PROMPT)
+                profile_record(PROF_WORKER_SUDO, elapsed_ns(&start));
+        }
+
+        pthread_mutex_lock(&async.lock);
+        if (segments & SEG_DIRTY) {
+            async.result.dirty = dirty;
+            free(async.result_cwd);
+            async.result_cwd = cwd;
+        }
+        else
+            free(cwd);
+        if (segments & SEG_SUDO)
+            async.result.sudo = sudo;
+        async.done = generation;
+        async.applied = false;
+        async.busy = false;
+        pthread_cond_broadcast(&async.cond);
+    }
+    return NULL;
+}
+
+/*
+ * prompt_event_hook: readline event hook, called periodically while waiting for input.
+ *  Redraws the prompt iff the result for the displayed prompt arrived and changes it.
+ */
+int prompt_event_hook(void) {
+    struct prompt_values values;
+    bool ready = false;
+
+    pthread_mutex_lock(&async.lock);
+    if (async.done == async.generation && !async.applied) {
+        values = async.result;
+        async.applied = ready = true;
+    }
+    pthread_mutex_unlock(&async.lock);
+
+    if (ready) {
+        char *prompt = render_prompt(displayed_status, &values);
+        if (!rl_prompt || strcmp(prompt, rl_prompt) != 0) {
+            rl_set_prompt(prompt);
+            rl_forced_update_display();
+        }
+    }
+    return 0;
+}
+
+/*
+ * prompt_invalidate_privileges: forces the next '%U' or '%$' expansion to re-probe sudo.
+ */
+void prompt_invalidate_privileges(void) {
+    pthread_mutex_lock(&privileges.lock);
+    privileges.valid = false;
+    pthread_mutex_unlock(&privileges.lock);
+}
+
+/*
+ * prompt_print_stats: prints the prompt cache statistics on stdout
+ */
+void prompt_print_stats(void) {
+    pthread_mutex_lock(&privileges.lock);
+    printf("privilege cache: %lu hits, %lu misses (ttl %ds)\n", privileges.hits,
+        privileges.misses, SUDO_TTL);
+    pthread_mutex_unlock(&privileges.lock);
+}
+
+/*
+ * prompt_print_profile: prints min, median and p99 of the time spent per segment kind over the
+ *  last PROFILE_RENDERS renders on stdout
+ */
+void prompt_print_profile(void) {
+    long sorted[PROFILE_RENDERS];
+    int i;
+    bool any = false;
+
+    printf("%-12s %8s %12s %12s %12s\n", "segment", "samples", "min (us)", "median (us)", "p99 (us)");
+    pthread_mutex_lock(&profile.lock);
+    for (i = 0; i < NB_PROF_SLOTS; i++) {
+        size_t n = (profile.count[i] < PROFILE_RENDERS) ? profile.count[i] : PROFILE_RENDERS;
+        if (n == 0)
+            continue;
+        memcpy(sorted, profile.samples[i], n * sizeof(long));
+        qsort(sorted, n, sizeof(long), cmp_long);
+        size_t p99 = (99 * n + 99) / 100 - 1;   // ceil(0.99 * n) - 1
+        printf("%-12s %8zu %12.1f %12.1f %12.1f\n", prof_names[i], n, sorted[0] / 1000.0,
+            sorted[n / 2] / 1000.0, sorted[p99] / 1000.0);
+        any = true;
+    }
+    pthread_mutex_unlock(&profile.lock);
+    if (!any)
+        printf("no samples%s; enable the profiler with 'prompt --profile on'\n",
+            PROFILE_PROMPT ? " yet" : "");
+}
+
+/*
+ * profile_record: adds a sample of the provided nb of nanoseconds to the provided profiler slot
+ */
+void profile_record(int slot, long ns) {
+    pthread_mutex_lock(&profile.lock);
+    profile.samples[slot][profile.count[slot]++ % PROFILE_RENDERS] = ns;
+    pthread_mutex_unlock(&profile.lock);
+}
+
+/*
+ * elapsed_ns: returns the nb of nanoseconds elapsed since the provided CLOCK_MONOTONIC time
+ */
+long elapsed_ns(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000L + (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * cmp_long: qsort() comparison function for longs
+ */
+int cmp_long(const void *a, const void *b) {
+    long x = *(const long*) a, y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * sudo_active: returns whether or not sudo access is currently activated, using the cached
+ *  result of the last sudo_probe() iff it isn't older than SUDO_TTL seconds
+ */
+bool sudo_active(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&privileges.lock);
+    if (privileges.valid && now.tv_sec - privileges.checked < SUDO_TTL) {
+        bool rv = privileges.active;
+        privileges.hits++;
+        pthread_mutex_unlock(&privileges.lock);
+        return rv;
+    }
+    privileges.misses++;
+    pthread_mutex_unlock(&privileges.lock);
+
+    bool active = sudo_probe();
+    pthread_mutex_lock(&privileges.lock);
+    privileges.valid = true;
+    privileges.active = active;
+    privileges.checked = now.tv_sec;
+    pthread_mutex_unlock(&privileges.lock);
+    printdebug("prompt: probed sudo: %s", active ? "active" : "inactive");
+    return active;
+}
+
+/*
+ * sudo_probe: returns whether or not sudo access is currently activated, i.e. iff
+ *  'sudo -n true' succeeds without asking for a password.
+ *  see e.g. http://stackoverflow.com/questions/122276/quickly-check-whether-sudo-permissions-are-available
+ */
+bool sudo_probe(void) {
+    int status;
+    pid_t pid = fork();
+    if (pid == -1)
+        return false;
+    else if (pid == 0) {
+        int fd = open("/dev/null", O_RDWR);
+        if (fd >= 0) {
+            dup2(fd, STDIN_FILENO);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execlp("sudo", "sudo", "-n", "true", (char*) NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    while (waitpid(pid, &status, 0) == -1)
+        if (errno != EINTR)
+            return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/*
+ * prompt_compile: returns a newly malloced prompt program for the provided prompt string.
+ *  All literal text and symbolic color expansion codes are resolved into literal spans
+ *  and every dynamic '%' expansion option into a single opcode, so rendering the prompt
+ *  is a linear walk over the program without re-parsing the prompt string.
+ * @note: unrecognized options are reported once here and skipped
+ */
+struct prompt_program *prompt_compile(const char *prompt) {
+    struct prompt_program *prog = malloc(sizeof(struct prompt_program));
+    size_t len = strlen(prompt), text_size = len + 1, segs_size = 8;
+    prog->text = malloc(text_size);
+    prog->segs = malloc(sizeof(struct prompt_segment) * segs_size);
+    prog->nb_segs = 0;
+    prog->async = 0;
+    size_t text_len = 0;
+
+    // append a literal span to the program, merged with a directly preceding literal
+    #define ADD_LITERAL(str, n) \
+        do { \
+            size_t n_ = (n); \
+            if (text_len + n_ + 1 > text_size) { \
+                text_size = 2 * (text_len + n_ + 1); \
+                prog->text = realloc(prog->text, text_size); \
+            } \
+            memcpy(prog->text + text_len, (str), n_); \
+            if (prog->nb_segs && prog->segs[prog->nb_segs-1].op == OP_LITERAL) \
+                prog->segs[prog->nb_segs-1].len += n_; \
+            else \
+                ADD_SEGMENT(OP_LITERAL, text_len, n_); \
+            text_len += n_; \
+        } while (false)
+
+    #define ADD_SEGMENT(opcode, off, n) \
+        do { \
+            if (prog->nb_segs == segs_size) { \
+                segs_size *= 2; \
+                prog->segs = realloc(prog->segs, sizeof(struct prompt_segment) * segs_size); \
+            } \
+            prog->segs[prog->nb_segs++] = (struct prompt_segment) {(opcode), (off), (n)}; \
+        } while (false)
+
+    // macro to insert a given ANSI escape color value str iff a given name str matches
+    #define CHK_COLOR(cname, cvalue) \
+        if (!strncmp(prompt+i+1, "{" cname "}", strlen("{" cname "}"))) { \
+            ADD_LITERAL(cvalue, strlen(cvalue)); \
+            i += strlen("{" cname "}"); \
+            break; \
+        }
+
+    size_t i, start;
+    for (i = 0; i < len; i++) {
+        /*** no prompt expansion; copy the literal span up to the next '%' verbatim ***/
+        if (prompt[i] != '%') {
+            for (start = i; i + 1 < len && prompt[i+1] != '%'; i++);
+            ADD_LITERAL(prompt + start, i - start + 1);
+            continue;
+        }
+
+        /*** check for '%' prompt expansion options ***/
+        i++;
+        switch (prompt[i]) {
+            case 'u':
+                ADD_SEGMENT(OP_USER, 0, 0);
+                break;
+            case 'U':
+                ADD_SEGMENT(OP_USER_SUDO, 0, 0);
+                prog->async |= SEG_SUDO;
+                break;
+            case '$':
+                ADD_SEGMENT(OP_SUDO_CHAR, 0, 0);
+                prog->async |= SEG_SUDO;
+                break;
+            case 'h':
+                ADD_SEGMENT(OP_HOST, 0, 0);
+                break;
+            case 's':
+                ADD_SEGMENT(OP_STATUS, 0, 0);
+                break;
+            case 'S':
+                ADD_SEGMENT(OP_STATUS_COLOR, 0, 0);
+                break;
+            case 'd':
+                ADD_SEGMENT(OP_DIR, 0, 0);
+                break;
+            case 'g':
+                ADD_SEGMENT(OP_GIT_BRANCH, 0, 0);
+                break;
+            case 'c':
+                ADD_SEGMENT(OP_GIT_DIRTY, 0, 0);
+                prog->async |= SEG_DIRTY;
+                break;
+            case '%':
+                ADD_LITERAL("%", 1);
+                break;
+            case 'B':
+                ADD_LITERAL(COLOR_BOLD, strlen(COLOR_BOLD));
+                break;
+            case 'n':
+                ADD_LITERAL(COLOR_RESET_BOLD, strlen(COLOR_RESET_BOLD));
+                break;
+            case 'f':
+                // fg color, normal
+                CHK_COLOR("black", BLACK_FG)
+                CHK_COLOR("red", RED_FG)
+                CHK_COLOR("green", GREEN_FG)
+                CHK_COLOR("yellow", YELLOW_FG)
+                CHK_COLOR("blue", BLUE_FG)
+                CHK_COLOR("magenta", MAGENTA_FG)
+                CHK_COLOR("cyan", CYAN_FG)
+                CHK_COLOR("white", WHITE_FG)
+                CHK_COLOR("reset", RESET_FG)
+                CHK_COLOR("resetall", COLOR_RESET_ALL)
+
+                printerr("prompt: skipping empty color prompt option: specify non-bold fg color with '%%f{color_name}'");
+                break;
+            case 'F':
+                // fg color, bold
+                CHK_COLOR("black", COLOR_BOLD BLACK_FG)
+                CHK_COLOR("red", COLOR_BOLD RED_FG)
+                CHK_COLOR("green", COLOR_BOLD GREEN_FG)
+                CHK_COLOR("yellow", COLOR_BOLD YELLOW_FG)
+                CHK_COLOR("blue", COLOR_BOLD BLUE_FG)
+                CHK_COLOR("magenta", COLOR_BOLD MAGENTA_FG)
+                CHK_COLOR("cyan", COLOR_BOLD CYAN_FG)
+                CHK_COLOR("white", COLOR_BOLD WHITE_FG)
+                CHK_COLOR("reset", COLOR_RESET_BOLD RESET_FG)
+                CHK_COLOR("resetall", COLOR_RESET_ALL)
+
+                printerr("prompt: skipping empty color prompt option: specify bold fg color with '%%F{color_name}'");
+                break;
+            case 'b':
+                // bg color, normal
+                CHK_COLOR("black", BLACK_BG)
+                CHK_COLOR("red", RED_BG)
+                CHK_COLOR("green", GREEN_BG)
+                CHK_COLOR("yellow", YELLOW_BG)
+                CHK_COLOR("blue", BLUE_BG)
+                CHK_COLOR("magenta", MAGENTA_BG)
+                CHK_COLOR("cyan", CYAN_BG)
+                CHK_COLOR("white", WHITE_BG)
+                CHK_COLOR("reset", RESET_BG)
+                CHK_COLOR("resetall", COLOR_RESET_ALL)
+
+                printerr("prompt: skipping empty color prompt option: specify bg color with '%%b{color_name}'");
+                break;
+            case '\0':
+                printerr("prompt: skipping trailing '%%' char; use '%%%%' for a verbatim '%%'");
+                break;
+            default:
+                printerr("prompt: skipping unrecognized prompt option '%%%c'", prompt[i]);
+                break;
+        }
+    }
+    prog->text[text_len] = '\0';
+    return prog;
+}
+
+/*
+ * prompt_free: free()s the provided prompt program
+ */
+void prompt_free(struct prompt_program *prog) {
+    if (!prog)
+        return;
+    free(prog->text);
+    free(prog->segs);
+    free(prog);
+}
+
+/*
+ * prompt_set: compiles the provided prompt string and installs it as the current prompt
+ */
+void prompt_set(const char *prompt) {
+    struct prompt_program *prog = prompt_compile(prompt);
+    prompt_free(prompt_program);
+    prompt_program = prog;
+    printdebug("prompt: compiled '%s' into %zu segments", prompt, prog->nb_segs);
+}
+
+/*
+ * render_prompt: return a string representing the command prompt (as defined by the current
+ *  prompt_program). When a directory is expanded in the prompt string, it is 'smart' truncated
+ *  to MAX_DIR_LENGTH.
+ * @arg values: the values of the slow segments; SEG_PENDING values are computed synchronously
+ * @return: a pointer to a static buffer, valid until the next call
+ */
+char *render_prompt(int status, struct prompt_values *values) {
+    // static string to hold the current prompt (return value) between function calls
+    static char *prompt = NULL;
+    static size_t size = 0;
+    char buf[MAX_PROMPT_BUF_LENGTH];    // used for int to string conversion
+    size_t len = 0, i;
+
+    // append n chars of str to the prompt, growing the buffer if needed
+    #define APPEND(str, n) \
+        do { \
+            size_t n_ = (n); \
+            if (len + n_ + 1 > size) { \
+                size = 2 * (len + n_ + 1); \
+                prompt = realloc(prompt, size); \
+            } \
+            memcpy(prompt + len, (str), n_); \
+            len += n_; \
+        } while (false)
+    #define APPEND_STR(str) \
+        do { \
+            const char *s_ = (str); \
+            if (s_) \
+                APPEND(s_, strlen(s_)); \
+        } while (false)
+
+    // time spent per segment kind in this render, iff profiling
+    long spent[NB_PROF_SLOTS] = {0};
+    bool used[NB_PROF_SLOTS] = {false};
+    bool profiling = PROFILE_PROMPT;
+    struct timespec start;
+
+    APPEND("", 0);
+    for (i = 0; i < prompt_program->nb_segs; i++) {
+        struct prompt_segment *seg = &prompt_program->segs[i];
+        if (profiling)
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        switch (seg->op) {
+            case OP_LITERAL:
+                APPEND(prompt_program->text + seg->offset, seg->len);
+                break;
+            case OP_USER:
+                APPEND_STR(state_user());
+                break;
+            case OP_USER_SUDO:
+                // make the username red and bold when sudo access is activated
+                if (values->sudo == SEG_PENDING)
+                    values->sudo = sudo_active();
+                if (values->sudo) {
+                    APPEND_STR(COLOR_BOLD RED_FG);
+                    APPEND_STR(state_user());
+                    APPEND_STR(COLOR_RESET_BOLD RESET_FG);
+                }
+                else
+                    APPEND_STR(state_user());
+                break;
+            case OP_SUDO_CHAR:
+                if (values->sudo == SEG_PENDING)
+                    values->sudo = sudo_active();
+                APPEND_STR(values->sudo ? "#" : "$");
+                break;
+            case OP_HOST:
+                APPEND_STR(state_hostname());
+                break;
+            case OP_STATUS:
+                APPEND(buf, snprintf(buf, MAX_PROMPT_BUF_LENGTH, "%d", status));
+                break;
+            case OP_STATUS_COLOR:
+                if (status)
+                    APPEND_STR(COLOR_BOLD RED_FG);
+                APPEND(buf, snprintf(buf, MAX_PROMPT_BUF_LENGTH, "%d", status));
+                if (status)
+                    APPEND_STR(COLOR_RESET_BOLD RESET_FG);
+                break;
+            case OP_DIR:
+                APPEND_STR(state_cwd_prompt(MAX_DIR_LENGTH));
+                break;
+            case OP_GIT_BRANCH:
+                {
+                char branch[MAX_BRANCH_LENGTH];
+                if (git_branch(state_cwd(), branch, MAX_BRANCH_LENGTH)) {
+                    APPEND_STR(" [");
+                    APPEND_STR(branch);
+                    APPEND_STR("]");
+                }
+                break;
+                }
+            case OP_GIT_DIRTY:
+                if (values->dirty == SEG_PENDING)
+                    values->dirty = git_is_dirty(state_cwd());
+                if (values->dirty == 1)
+                    APPEND_STR(COLOR_BOLD RED_FG "*" COLOR_RESET_BOLD RESET_FG);
+                break;
+        }
+        if (profiling) {
+            spent[seg->op] += elapsed_ns(&start);
+            used[seg->op] = true;
+        }
+    }
+    prompt[len] = '\0';
+
+    if (profiling)
+        for (i = 0; i < NB_PROF_SLOTS; i++)
+            if (used[i])
+                profile_record(i, spent[i]);
+    return prompt;
+}
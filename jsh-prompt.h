@@ -0,0 +1,80 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_PROMPT_H_INCLUDED
+#define JSH_PROMPT_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+#define DEFAULT_PROMPT          "%B%u%n@%h[%S]::%f{yellow}%d%f{reset}%$ "    // default init prompt string: "user@host[status]:pwd$ "
+
+extern int MAX_DIR_LENGTH;          // the maximum length of an expanded pwd substring in the prompt string
+extern bool ASYNC_PROMPT;           // whether or not slow prompt segments are computed in the background
+extern int SUDO_TTL;                // max nb of seconds the cached sudo state for '%U' and '%$' is used
+extern bool PROFILE_PROMPT;         // whether or not the time spent per prompt segment is recorded
+
+/*
+ * getprompt: return a string representing the command prompt (as defined by the current prompt string)
+ *  iff IS_INTERACTIVE, else the empty string is returned.
+ * @note: when ASYNC_PROMPT is on, the slow segments ('%c', '%U' and '%$') are rendered with a
+ *  placeholder and computed by a background worker; the prompt is redrawn by readline's
+ *  event hook as soon as the result arrives.
+ */
+char *getprompt(int);
+
+/*
+ * prompt_set: compiles the provided prompt string once into a list of literal spans (with
+ *  resolved color codes) and dynamic segment opcodes, and installs it as the current prompt.
+ *  Unrecognized prompt expansion options are reported and skipped.
+ */
+void prompt_set(const char*);
+
+/*
+ * prompt_init: starts the background prompt worker and installs the readline redisplay hook.
+ *  Should be called once at startup; a no-op iff !IS_INTERACTIVE.
+ */
+void prompt_init(void);
+
+/*
+ * prompt_settle: blocks until the background worker finished computing the segments of the
+ *  last displayed prompt, if any. Should be called before executing an input line, so the
+ *  worker's child processes don't interfere with the waiting for the command's children.
+ */
+void prompt_settle(void);
+
+/*
+ * prompt_invalidate_privileges: discards the cached sudo state, so the next '%U' or '%$'
+ *  expansion probes sudo again. Should be called when a command line may change it.
+ */
+void prompt_invalidate_privileges(void);
+
+/*
+ * prompt_print_stats: prints the hit/miss counters of the prompt caches on stdout
+ */
+void prompt_print_stats(void);
+
+/*
+ * prompt_print_profile: prints min, median and p99 of the time spent per prompt segment kind
+ *  ('%u', '%d', ..., literal text and colors) over the most recent renders on stdout.
+ *  Samples are only recorded while PROFILE_PROMPT is on.
+ */
+void prompt_print_profile(void);
+
+#endif // JSH_PROMPT_H_INCLUDED
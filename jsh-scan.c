@@ -0,0 +1,186 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * ----------------------------------------------------------------------
+ * jsh-scan.c: vectorized search for special chars. The lexer spends most of its time
+ *  skipping over the plain chars of words and quoted strings; on x86 this module classifies
+ *  16 (SSE2) or 32 (AVX2) chars per instruction instead of one, with a portable scalar
+ *  fallback. The implementation is chosen once, based on what the CPU supports.
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+    #define HAVE_SSE2 1
+    #define HAVE_AVX2 1     // compiled with a target attribute; only called iff the CPU supports it
+    #include <immintrin.h>
+#endif
+
+// #################### helper function definitions ####################
+size_t scan_scalar(const struct scan_set*, const char*, size_t);
+size_t scan_first(const struct scan_set*, const char*, size_t);
+#if HAVE_SSE2
+size_t scan_sse2(const struct scan_set*, const char*, size_t);
+#endif
+#if HAVE_AVX2
+size_t scan_avx2(const struct scan_set*, const char*, size_t);
+#endif
+
+size_t (*scanner)(const struct scan_set*, const char*, size_t) = scan_first;
+
+void scan_set_init(struct scan_set *set, const char *chars) {
+    unsigned char hi_bits[16] = {0};
+    int nb_hi = 0;
+
+    memset(set, 0, sizeof(struct scan_set));
+    for (; *chars; chars++) {
+        unsigned char c = *chars;
+        if (set->member[c])
+            continue;
+        #if ASSERT
+            assert(c < 0x80 && set->nb < SCAN_SET_MAX);
+        #endif
+        set->member[c] = true;
+        set->chars[set->nb++] = c;
+
+        // assign every distinct high nibble its own bit
+        if (!hi_bits[c >> 4]) {
+            #if ASSERT
+                assert(nb_hi < 8);
+            #endif
+            hi_bits[c >> 4] = 1 << nb_hi++;
+        }
+        set->hi[c >> 4] = hi_bits[c >> 4];
+        set->lo[c & 0xf] |= hi_bits[c >> 4];
+    }
+    int i;
+    for (i = 0; i < SCAN_SET_MAX && set->nb > 0; i++)
+        memset(set->splat[i], set->chars[i < set->nb ? i : set->nb - 1], 16);
+}
+
+/*
+ * @note: inline function implementation should be in header. Moreover one extern
+ *  declaration should be used, to tell the compiler where to put the non-inlined function,
+ *  if needed.
+ */
+extern inline size_t scan(const struct scan_set*, const char*, size_t);
+
+bool scan_use(enum scan_impl impl) {
+    switch (impl) {
+        case SCAN_SCALAR:
+            scanner = scan_scalar;
+            return true;
+        #if HAVE_SSE2
+        case SCAN_SSE2:
+            scanner = scan_sse2;
+            return true;
+        #endif
+        #if HAVE_AVX2
+        case SCAN_AVX2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2"))
+                return false;
+            scanner = scan_avx2;
+            return true;
+        #endif
+        default:
+            return false;
+    }
+}
+
+const char *scan_impl_name(enum scan_impl impl) {
+    static const char *names[] = {"scalar", "sse2", "avx2"};
+    return names[impl];
+}
+
+/*
+ * scan_first: selects the fastest supported implementation and scans with it
+ */
+size_t scan_first(const struct scan_set *set, const char *s, size_t len) {
+    int impl = SCAN_NB_IMPLS;
+    while (!scan_use(--impl))
+        ;
+    printdebug("scan: using the %s scanner", scan_impl_name(impl));
+    return scanner(set, s, len);
+}
+
+/*
+ * scan_scalar: the portable implementation, one table lookup per char
+ */
+size_t scan_scalar(const struct scan_set *set, const char *s, size_t len) {
+    size_t i;
+    for (i = 0; i < len; i++)
+        if (set->member[(unsigned char) s[i]])
+            return i;
+    return len;
+}
+
+#if HAVE_SSE2
+/*
+ * scan_sse2: compares 16 chars at a time with every char in the set. The comparisons are
+ *  spread over four independent accumulators, so they don't wait on each other.
+ */
+size_t scan_sse2(const struct scan_set *set, const char *s, size_t len) {
+    const __m128i *needles = (const __m128i*) set->splat;
+    size_t i = 0;
+    int j, nb = (set->nb + 3) & ~3;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (s + i));
+        __m128i hits0 = _mm_setzero_si128(), hits1 = hits0, hits2 = hits0, hits3 = hits0;
+        for (j = 0; j < nb; j += 4) {
+            hits0 = _mm_or_si128(hits0, _mm_cmpeq_epi8(block, _mm_loadu_si128(needles + j)));
+            hits1 = _mm_or_si128(hits1, _mm_cmpeq_epi8(block, _mm_loadu_si128(needles + j + 1)));
+            hits2 = _mm_or_si128(hits2, _mm_cmpeq_epi8(block, _mm_loadu_si128(needles + j + 2)));
+            hits3 = _mm_or_si128(hits3, _mm_cmpeq_epi8(block, _mm_loadu_si128(needles + j + 3)));
+        }
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(hits0, hits1), _mm_or_si128(hits2, hits3)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scan_scalar(set, s + i, len - i);
+}
+#endif
+
+#if HAVE_AVX2
+/*
+ * scan_avx2: classifies 32 chars at a time with two nibble table lookups, independent of the
+ *  size of the set: c is in the set iff (lo[c & 0xf] & hi[c >> 4]) != 0
+ */
+__attribute__((target("avx2")))
+size_t scan_avx2(const struct scan_set *set, const char *s, size_t len) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) set->lo));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) set->hi));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*) (s + i));
+        // note: the shuffle yields 0 for indices with the high bit set, so mask them first
+        __m256i lo_bits = _mm256_shuffle_epi8(lo, _mm256_and_si256(block, nibble));
+        __m256i hi_bits = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        __m256i misses = _mm256_cmpeq_epi8(_mm256_and_si256(lo_bits, hi_bits), _mm256_setzero_si256());
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(misses);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scan_scalar(set, s + i, len - i);
+}
+#endif
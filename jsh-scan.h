@@ -0,0 +1,82 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_SCAN_H_INCLUDED
+#define JSH_SCAN_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+#define SCAN_SET_MAX            16      // max nb of chars in a scan set
+#define SCAN_SHORT_RUN          8       // nb of chars checked one by one before a vector scan
+
+/*
+ * a set of special (ASCII) chars to scan for, preprocessed for every scanner implementation
+ */
+struct scan_set {
+    bool member[256];           // scalar: member[c] iff c is in the set
+    char chars[SCAN_SET_MAX];   // the chars in the set
+    int nb;
+    unsigned char splat[SCAN_SET_MAX][16];  // SSE2: every char repeated 16 times, padded to a
+                                            //  multiple of four chars by repeating the last one
+    unsigned char lo[16];       // AVX2: nibble lookup tables; c is in the set iff
+    unsigned char hi[16];       //  (lo[c & 0xf] & hi[c >> 4]) != 0
+};
+
+/*
+ * the available scanner implementations, from slowest to fastest
+ */
+enum scan_impl {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2, SCAN_NB_IMPLS};
+
+/*
+ * scan_set_init: initializes the provided set with the chars of the provided string. At most 8
+ *  distinct high nibbles and SCAN_SET_MAX chars are supported, which is plenty for shell syntax.
+ */
+void scan_set_init(struct scan_set*, const char *chars);
+
+// the selected scanner implementation; don't call directly
+extern size_t (*scanner)(const struct scan_set*, const char*, size_t);
+
+/*
+ * scan: returns the index of the first char in s[0, len) that is a member of the provided set,
+ *  or len iff there is none. Compares 16 (SSE2) or 32 (AVX2) chars at a time iff supported
+ *  by the CPU; the scanner is selected on first use.
+ * @note: inline function implementations should be in header; most words are short, so the
+ *  first chars are checked inline, before setting up a vector scan
+ */
+static inline size_t scan(const struct scan_set *set, const char *s, size_t len) {
+    size_t i, n = (len < SCAN_SHORT_RUN) ? len : SCAN_SHORT_RUN;
+    for (i = 0; i < n; i++)
+        if (set->member[(unsigned char) s[i]])
+            return i;
+    return (n == len) ? len : n + scanner(set, s + n, len - n);
+}
+
+/*
+ * scan_use: selects the scanner implementation used by scan(); returns false and leaves it
+ *  unchanged iff the implementation isn't supported by the compiler or the CPU.
+ */
+bool scan_use(enum scan_impl);
+
+/*
+ * scan_impl_name: returns a human readable name for the provided implementation
+ */
+const char *scan_impl_name(enum scan_impl);
+
+#endif // JSH_SCAN_H_INCLUDED
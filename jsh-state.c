@@ -0,0 +1,147 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ----------------------------------------------------------------------
+ * jsh-state.c: a cached layer over the parts of the process state the prompt expands on
+ *  every render. The hostname and user name are resolved once at startup; the cwd (and
+ *  its prompt form) is only updated when the shell itself changes directory, i.e. from
+ *  the 'cd' built-in through state_chdir().
+ * ----------------------------------------------------------------------
+ */
+
+#include "jsh-state.h"
+#include <pwd.h>
+
+/*
+ * the cached shell state. Only accessed from the main thread: the prompt worker gets
+ *  its own copy of the cwd.
+ */
+struct {
+    char *user;
+    char *hostname;
+    char *cwd;
+    char *cwd_prompt;           // the cached state_cwd_prompt() result
+    int cwd_prompt_maxlen;      // the maxlen the cached cwd_prompt was computed for
+} state = {NULL, NULL, NULL, NULL, -1};
+
+// #################### helper function definitions ####################
+void update_cwd(void);
+
+/*
+ * state_init: resolves the cached shell state
+ */
+void state_init(void) {
+    char *user = getenv("USER");
+    if (!user) {
+        struct passwd *pw = getpwuid(getuid());
+        user = pw ? pw->pw_name : "";
+    }
+    free(state.user);
+    state.user = strclone(user);
+
+    long hostlen = sysconf(_SC_HOST_NAME_MAX);
+    hostlen = (hostlen > 0 ? hostlen : HOST_NAME_MAX) + 1;    // plus one for null terminate
+    free(state.hostname);
+    state.hostname = malloc(hostlen);
+    if (gethostname(state.hostname, hostlen) != 0)
+        state.hostname[0] = '\0';
+    state.hostname[hostlen-1] = '\0';   // always null-terminate
+
+    update_cwd();
+}
+
+const char *state_user(void) {
+    return state.user ? state.user : "";
+}
+
+const char *state_hostname(void) {
+    return state.hostname ? state.hostname : "";
+}
+
+const char *state_cwd(void) {
+    if (!state.cwd)
+        update_cwd();
+    return state.cwd;
+}
+
+/*
+ * state_cwd_prompt: returns the '~'-abbreviated, truncated current working directory
+ */
+const char *state_cwd_prompt(int maxlen) {
+    if (state.cwd_prompt && maxlen == state.cwd_prompt_maxlen)
+        return state.cwd_prompt;
+
+    // replace the home dir with '~' iff the cwd is (inside) the home dir
+    const char *cwd = state_cwd();
+    const char *home = gethome();
+    size_t homelen = strlen(home);
+    while (homelen > 1 && home[homelen-1] == '/')
+        homelen--;
+    char *dir;
+    if (homelen > 1 && strncmp(cwd, home, homelen) == 0 && (cwd[homelen] == '/' || cwd[homelen] == '\0')) {
+        dir = malloc(strlen(cwd + homelen) + 2);
+        dir[0] = '~';
+        strcpy(dir + 1, cwd + homelen);
+    }
+    else
+        dir = strclone(cwd);
+
+    // truncate to the first char after the first '/' within the last maxlen chars
+    int dirlen = strlen(dir);
+    char *ptr = dir;
+    if (dirlen > maxlen) {
+        ptr = strchr(dir + dirlen - maxlen, '/');
+        if (!ptr)
+            ptr = dir + dirlen - maxlen;
+        else if (ptr < dir + dirlen - 1)
+            ptr++;
+    }
+    free(state.cwd_prompt);
+    state.cwd_prompt = strclone(ptr);
+    state.cwd_prompt_maxlen = maxlen;
+    free(dir);
+    return state.cwd_prompt;
+}
+
+/*
+ * state_chdir: changes the current working directory and updates the cached state
+ */
+int state_chdir(const char *dir) {
+    int rv = chdir(dir);
+    if (rv == 0) {
+        update_cwd();
+        setenv("PWD", state.cwd, 1);
+    }
+    return rv;
+}
+
+/*
+ * update_cwd: re-reads the current working directory and discards the cached prompt form
+ */
+void update_cwd(void) {
+    char *cwd = getcwd(NULL, 0); //TODO portability: this is GNU libc specific...
+    if (!cwd) {
+        // e.g. the cwd was removed; fall back to the last known value
+        char *pwd = getenv("PWD");
+        cwd = strclone(pwd ? pwd : (state.cwd ? state.cwd : "."));
+    }
+    free(state.cwd);
+    state.cwd = cwd;
+    free(state.cwd_prompt);
+    state.cwd_prompt = NULL;
+}
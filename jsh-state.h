@@ -0,0 +1,62 @@
+/* This file is part of jsh.
+ *
+ * jsh: A basic UNIX shell implementation in C
+ * Copyright (C) 2014 Jo Van Bulck <jo.vanbulck@student.kuleuven.be>
+ *
+ * jsh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * jsh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSH_STATE_H_INCLUDED
+#define JSH_STATE_H_INCLUDED
+/* ^^ these are the include guards */
+
+#include "jsh-common.h"
+
+/*
+ * state_init: resolves the cached shell state (user name, hostname and current working
+ *  directory). Should be called once at startup, before the first state_* query.
+ */
+void state_init(void);
+
+/*
+ * state_user: returns the cached name of the current user; never NULL
+ */
+const char *state_user(void);
+
+/*
+ * state_hostname: returns the hostname, as resolved once by state_init()
+ */
+const char *state_hostname(void);
+
+/*
+ * state_cwd: returns the cached absolute path of the current working directory
+ */
+const char *state_cwd(void);
+
+/*
+ * state_cwd_prompt: returns the current working directory with the home directory replaced
+ *  by '~', 'smart' truncated to the first path component within the last @param(maxlen) chars.
+ * @note: the result is cached and only recomputed after a state_chdir() or when
+ *  @param(maxlen) changes.
+ */
+const char *state_cwd_prompt(int maxlen);
+
+/*
+ * state_chdir: changes the current working directory to @param(dir) and updates the cached
+ *  cwd and the PWD environment variable on success.
+ * @return: the return value of chdir(); errno is set on failure
+ */
+int state_chdir(const char *dir);
+
+#endif // JSH_STATE_H_INCLUDED
@@ -18,10 +18,15 @@
  */
 
 #include "jsh-common.h"
-#include "jsh-colors.h"
 #include "alias.h"
 #include "jsh-parse.h"
 #include "jsh-completion.h"
+#include "jsh-prompt.h"
+#include "jsh-state.h"
+#include "jsh-jobs.h"
+#include "jsh-parallel.h"
+#include "jsh-cache.h"
+#include "jsh-func.h"
 #include <signal.h>
 #include <setjmp.h>
 #include <readline/readline.h>      // GNU readline: http://cnswww.cns.cwru.edu/php/chet/readline/rltop.html
@@ -35,20 +40,16 @@
 #define HISTFILE                ".jsh_history"
 #define LOGIN_FILE              ".jsh_login"
 #define LOGOUT_FILE             ".jsh_logout"
-#define DEFAULT_PROMPT          "%B%u%n@%h[%S]::%f{yellow}%d%f{reset}%$ "    // default init prompt string: "user@host[status]:pwd$ "
-#define MAX_PROMPT_LENGTH       250                 // maximum length of the displayed prompt string
-#define MAX_PROMPT_BUF_LENGTH   50                  // the max number of msd of a status integer in the prompt string
+#define CONTINUATION_PROMPT     "> "    // prompt for the next line of an unclosed function definition
 // ########## function declarations ##########
 void option(char*);
 void things_todo_at_start(void);
 void things_todo_at_exit(void);
-char *getprompt(int);
 char *readcmd(int status);
 int is_built_in(comd*);
 int parse_built_in(comd*, int);
 void sig_int_handler(int);
 void touch_config_files(void);
-char *resolve_prompt_colors(char*);
 
 // ########## global variables ##########
 #ifdef NODEBUG
@@ -74,17 +75,16 @@ bool I_AM_FORK = false;
 bool IS_INTERACTIVE;            // initialized in things_todo_at_start; (compiler's 'constant initializer' complaints)
 int nb_hist_entries = 0;        // number of saved hist entries in this jsh session
 sigjmp_buf ctrlc_buf;           // buf used for setjmp/longjmp when SIGINT received
-char *user_prompt_string = "$ ";// initialized in things_todo_at_start function
-int MAX_DIR_LENGTH = 25;        // the maximum length of an expanded pwd substring in the prompt string
 
 /*
  * built_ins[] = array of built_in cmd names; should be sorted with 'qsort(built_ins, nb_built_ins, sizeof(char*), string_cmp);'
  * built_in enum = value corresponds to index in built_ins[]
  */
-const char *built_ins[] = {"", "F", "T", "alias", "cd", "color", "debug",\
-"exit", "history", "prompt", "shcat", "source", "unalias"};
+const char *built_ins[] = {"", "F", "T", "alias", "bg", "cd", "color", "debug",\
+"exit", "fg", "functions", "hash", "history", "jobs", "parallel", "pipestatus", "prompt", "set", "shcat", "source", "stats", "unalias", "unfunction", "wait"};
 const size_t nb_built_ins = sizeof(built_ins)/sizeof(built_ins[0]);
-enum built_in {EMPTY, F, T, ALIAS, CD, CLR, DBG, EXIT, HIST, PROMPT, SHCAT, SRC, UNALIAS};
+enum built_in {EMPTY, F, T, ALIAS, BG, CD, CLR, DBG, EXIT, FG, FUNCS, HASH, HIST, JOBS, PARALLEL, PIPESTATUS, PROMPT, SET,
+    SHCAT, SRC, STATS, UNALIAS, UNFUNC, WAIT};
 typedef enum built_in built_in;
 
 /*
@@ -106,12 +106,18 @@ int main(int argc, char **argv) {
     // after receiving SIGINT, program is continued on the next line
     if (sigsetjmp(ctrlc_buf, 1) == 0)
         status = 0;     // get here on direct call
-    else
+    else {
         status = -1;    // get here by SIGINT signal
+        cache_unpin_all();
+        func_unwind();
+        arena_reset(&line_arena);   // the interrupted line's arena_release() calls were skipped
+        parse_discard_input();
+    }
     
     char *s;
     while ((s = readcmd(status)) != NULL)
         status = parseexpr(s);
+    parse_end_input("input");
         
     exit(EXIT_SUCCESS);
 }
@@ -253,12 +259,18 @@ void things_todo_at_start(void) {
     alias("~", gethome());
     
     // default prompt
-    user_prompt_string = resolve_prompt_colors(DEFAULT_PROMPT);
+    state_init();
+    prompt_set(DEFAULT_PROMPT);
+    prompt_init();
+    jobs_init();
+    if (IS_INTERACTIVE)
+        path_catalog_prefetch();
     
     // read ~/.jshrc if any
     if (LOAD_RC) {
         path = concat(3, gethome(), "/", RCFILE);
-        parsefile(path, (void (*)(char*)) parse_from_file, false);
+        parsefile(path, (void (*)(char*)) parseexpr, false);
+        parse_end_input(RCFILE);
         free(path);
     }
     
@@ -311,7 +323,8 @@ void things_todo_at_exit(void) {
         bool dbg = DEBUG;
         DEBUG = false;
         char *path = concat(3, gethome(), "/", LOGOUT_FILE);
-        parsefile(path, (void (*)(char*)) parse_from_file, false);
+        parsefile(path, (void (*)(char*)) parseexpr, false);
+        parse_end_input(LOGOUT_FILE);
         free(path);
         DEBUG = dbg;
         printdebug("'%s' executed", LOGOUT_FILE);
@@ -326,275 +339,8 @@ void things_todo_at_exit(void) {
 }
 
 /*
- * getprompt: return a string representing the command prompt (as defined by the user_prompt_string)
- *  iff IS_INTERACTIVE, else the empty string is returned. The returned string is guaranteed to be less then 
- *  MAX_PROMPT_LENGTH; when a directory is expanded in the prompt string, it is 'smart' truncated to MAX_DIR_LENGTH.
- *  When a status integer or git branch is included in the prompt string, the strings length is truncated to MAX_PROMPT_BUF_LENGTH.
- */
-char* getprompt(int status) {    
-    // static string to hold the current prompt (return value) between function calls
-    static char prompt[MAX_PROMPT_LENGTH] = "";
-    static char buf[MAX_PROMPT_BUF_LENGTH] = "";    // used for char / int to string conversion 
-    
-    if (!IS_INTERACTIVE)
-        return "";    
-
-    prompt[0] = '\0';               // clear the prev prompt
-    char *next;                     // points to the next substring to add to the prompt
-    int i;
-    for (i = 0; i < strlen(user_prompt_string); i++) {
-        /*** check for '%' prompt expansion options ***/
-        if (user_prompt_string[i] == '%') {
-            i++; // potentially overread the '\0' char (harmless)
-            switch (user_prompt_string[i]) {
-                case 'u':
-                    next = getenv("USER");
-                    break;
-                case 'U':
-                    {
-                    char *username = getenv("USER");
-                    // make the username red and bold when sudo access is activated
-                    // see e.g. http://stackoverflow.com/questions/122276/quickly-check-whether-sudo-permissions-are-available
-                    char *cur_user_has_sudo = strclone("sudo -n true > /dev/null 2> /dev/null");
-	                if (parseexpr(cur_user_has_sudo) == EXIT_SUCCESS) {
-	                    snprintf(buf, MAX_PROMPT_BUF_LENGTH, "%s%s%s", COLOR_BOLD RED_FG, \
-	                        username, COLOR_RESET_BOLD RESET_FG);
-	                    next = buf;
-	                }
-	                else
-	                    next = username;
-	                
-	                free(cur_user_has_sudo);
-                    break;
-                    }
-                case '$':
-                    {
-                    char *cur_user_has_sudo = strclone("sudo -n true > /dev/null 2> /dev/null");
-	                if (parseexpr(cur_user_has_sudo) == EXIT_SUCCESS)
-	                    next = "#";
-	                else
-	                    next = "$";
-	                
-	                free(cur_user_has_sudo);
-                    break;
-                    }
-                case 'h':
-                    {
-                    int hostlen = sysconf(_SC_HOST_NAME_MAX)+1; // Plus one for null terminate
-                    char hostname[hostlen];
-                    gethostname(hostname, hostlen);
-                    hostname[hostlen-1] = '\0'; // Always null-terminate                     
-                    next = hostname;
-                    break;
-                    }
-                case 's':
-                    snprintf(buf, MAX_PROMPT_BUF_LENGTH, "%d", status);
-                    next = buf;
-                    break;
-                case 'S':
-                    if (!status)
-                        snprintf(buf, MAX_PROMPT_BUF_LENGTH, "%d", status);
-                    else
-                        snprintf(buf, MAX_PROMPT_BUF_LENGTH, "%s%d%s", COLOR_BOLD RED_FG, \
-	                        status, COLOR_RESET_BOLD RESET_FG);
-                    next = buf;
-                    break;
-                case 'd':
-                    {
-                    // get the directory                
-                    char *cwd = getcwd(NULL, 0); //TODO portability: this is GNU libc specific... + errchk
-                    
-                    // replace the home dir with '~' if any
-                    char *home = gethome();
-                    if (strstr(cwd, home)) {
-                        cwd = cwd + strlen(home)-1;
-                        cwd[0] = '~';
-                    }
-                    
-                    int cwdlen = strlen(cwd);
-                    char *ptr = NULL;
-                    // get a ptr to the first '/' + 1 within the truncated directory string
-                    if (cwdlen > MAX_DIR_LENGTH) {
-                        ptr = strchr(cwd + cwdlen - MAX_DIR_LENGTH, '/');
-                        ptr = (ptr && ptr < cwd+cwdlen-1)? ptr+1 : ptr;
-                    }
-                    next = ptr? ptr : cwd + ((MAX_DIR_LENGTH < cwdlen) ? cwdlen - MAX_DIR_LENGTH : 0);
-                    break;
-                    }
-                case 'g':
-                    {
-                    char *pwd_is_git = strclone("git rev-parse --git-dir > /dev/null 2> /dev/null");
-	                if (parseexpr(pwd_is_git) == EXIT_SUCCESS) {
-	                    FILE *fp = popen("git symbolic-ref --short -q HEAD", "r");
-	                    buf[0] = ' ';
-	                    buf[1] = '[';
-	                    buf[MAX_PROMPT_BUF_LENGTH-2] = ']';
-	                    buf[MAX_PROMPT_BUF_LENGTH-1] = '\0';
-	                    int j;
-	                    for (j = 2; j < MAX_PROMPT_BUF_LENGTH-2; j++) {
-	                        int cur = getc(fp);
-	                        if (cur == EOF || cur == '\n') {
-	                            buf[j++] = ']';
-	                            buf[j] = '\0';
-	                            break;
-	                        }
-	                        else
-	                            buf[j] = cur;
-	                    }
-	                    next = buf;
-	                    pclose(fp);
-	                }
-	                else
-	                    next = "";
-	                free(pwd_is_git);
-	                break;
-	                }
-	            case 'c':
-	                {
-                    char *pwd_is_git = strclone("git rev-parse --git-dir > /dev/null 2> /dev/null");
-	                char *files_have_changed = strclone("git diff --exit-code > /dev/null 2> /dev/null");                    
-	                if ( (parseexpr(pwd_is_git) == EXIT_SUCCESS) && (parseexpr(files_have_changed) != EXIT_SUCCESS) ) {
-                        snprintf(buf, MAX_PROMPT_BUF_LENGTH, "%s%c%s", COLOR_BOLD RED_FG, \
-	                        '*', COLOR_RESET_BOLD RESET_FG);
-	                    next = buf;
-                    }
-	                else
-	                    next = "";
-	                free(pwd_is_git);
-                    free(files_have_changed);	                
-	                break;
-	                }
-                case '%':
-                    next = "%";
-                    break;
-                default:
-                    printerr("skipping unrecognized prompt option '%%%c'", user_prompt_string[i]);
-                    next = "";
-                    break;
-            }
-        }
-        /*** no prompt expansion; copy the char verbatim ***/        
-        else {
-            sprintf(buf, "%c", user_prompt_string[i]);
-            next = buf;
-        }
-        
-        /*** check length of string to concat; abort to avoid an overflow ***/
-        if ((strlen(prompt) + strlen(next)) >= MAX_PROMPT_LENGTH) {
-            printerr("Prompt expansion too long: not concatting '%s'. Now returning...", next);
-            return prompt;
-        }
-        strcat(prompt, next);
-    }
-    return prompt;
-}
-
-/**
- * resolve_prompt_colors: return a newly malloced prompt string with the
- *  symbolic color expansion codes replaced with the corresponding ANSI escape codes.
- *  This function can be called once on new promp initialisation to save time on
- *  subsequent prompt re-evaluations.
- * NOTE: the return value is a malloced str with length MAX_PROMPT_LENGTH; when the 
- *  expansion is longer, it is truncated and an error message is written to stdout
- */
-char *resolve_prompt_colors(char *prompt) {
-    char *rv = malloc(MAX_PROMPT_LENGTH);
-    rv[0] = '\0';
-    char buf[3]; // to hold the next char and '%' temporarily to append to rv
-
-    // macro to insert a given ANSI escape color value str iff a given name str matches
-    #define CHK_COLOR(cname, cvalue) \
-        if (!strncmp(prompt+i+1, "{" cname "}", strlen("{" cname "}"))) { \
-            next = cvalue; \
-            i += strlen("{" cname "}"); \
-            break; \
-        } 
-    
-    char *next;
-    int i;
-    for (i = 0; i < strlen(prompt); i++) {
-        if (prompt[i] == '%') {
-            i++; // potentially overread the '\0' char (harmless)
-            switch (prompt[i]) {
-                case 'f':
-                    // fg color, normal
-                    CHK_COLOR("black", BLACK_FG)
-                    CHK_COLOR("red", RED_FG)
-                    CHK_COLOR("green", GREEN_FG)
-                    CHK_COLOR("yellow", YELLOW_FG)
-                    CHK_COLOR("blue", BLUE_FG)
-                    CHK_COLOR("magenta", MAGENTA_FG)
-                    CHK_COLOR("cyan", CYAN_FG)
-                    CHK_COLOR("white", WHITE_FG)
-                    CHK_COLOR("reset", RESET_FG)
-                    CHK_COLOR("resetall", COLOR_RESET_ALL)
-                    
-                    printerr("resolve_prompt_colors: skipping empty color prompt option: specify non-bold fg color with '%%f{color_name}'");
-                    next = "";
-                    break;
-                 case 'F':
-                    // fg color, bold
-                    CHK_COLOR("black", COLOR_BOLD BLACK_FG)
-                    CHK_COLOR("red", COLOR_BOLD RED_FG)
-                    CHK_COLOR("green", COLOR_BOLD GREEN_FG)
-                    CHK_COLOR("yellow", COLOR_BOLD YELLOW_FG)
-                    CHK_COLOR("blue", COLOR_BOLD BLUE_FG)
-                    CHK_COLOR("magenta", COLOR_BOLD MAGENTA_FG)
-                    CHK_COLOR("cyan", COLOR_BOLD CYAN_FG)
-                    CHK_COLOR("white", COLOR_BOLD WHITE_FG)
-                    CHK_COLOR("reset", COLOR_RESET_BOLD RESET_FG)
-                    CHK_COLOR("resetall", COLOR_RESET_ALL)
-                    
-                    printerr("resolve_prompt_colors: skipping empty color prompt option: specify bold fg color with '%%f{color_name}'");
-                    next = "";
-                    break;
-                case 'B':
-                    next = COLOR_BOLD;
-                    break;
-                case 'n':
-                    next = COLOR_RESET_BOLD;
-                    break;
-                case 'b':
-                    // bg color, normal
-                    CHK_COLOR("black", BLACK_BG)
-                    CHK_COLOR("red", RED_BG)
-                    CHK_COLOR("green", GREEN_BG)
-                    CHK_COLOR("yellow", YELLOW_BG)
-                    CHK_COLOR("blue", BLUE_BG)
-                    CHK_COLOR("magenta", MAGENTA_BG)
-                    CHK_COLOR("cyan", CYAN_BG)
-                    CHK_COLOR("white", WHITE_BG)
-                    CHK_COLOR("reset", RESET_BG)
-                    CHK_COLOR("resetall", COLOR_RESET_ALL)
-                    
-                    printerr("resolve_prompt_colors: skipping empty color prompt option: specify bg color with '%%b{color_name}'");
-                    next = "";
-                    break;
-                default:
-                    sprintf(buf, "%%%c", prompt[i]);
-                    next = buf;
-                    break;
-            }
-        }
-        /*** no prompt expansion; copy the char verbatim ***/        
-        else {
-            sprintf(buf, "%c", prompt[i]);
-            next = buf;
-        }
-        
-        /*** check length of string to concat; abort to avoid an overflow ***/
-        if ((strlen(rv) + strlen(next)) >= MAX_PROMPT_LENGTH) {
-            printerr("Prompt expansion too long: not concatting '%s'. Now returning...", next);
-            return rv;
-        }
-        strcat(rv, next);
-    }
-    return rv;   
-}
-
-/*
- * readcmd: read the next inputline from stdin, add it to the history and resolve all aliases.
- *  returns the resolved inputline or NULL if EOF on a blank line
+ * readcmd: read the next inputline from stdin, expand history references and add it to the history.
+ *  returns the inputline or NULL if EOF on a blank line (aliases are expanded by parseexpr())
  * TODO remove status arg?
  */
 char *readcmd(int status) {
@@ -607,16 +353,21 @@ char *readcmd(int status) {
         free(buf); // If the buffer has already been allocated, return the memory to the free pool.
         buf = NULL;
     }
-    buf = readline(getprompt(status));  //TODO fall back to getline() when non-interactive...
+    if (IS_INTERACTIVE)
+        jobs_notify();
+    buf = readline((IS_INTERACTIVE && parse_pending()) ? CONTINUATION_PROMPT : getprompt(status));  //TODO fall back to getline() when non-interactive...
+    prompt_settle();
     
-    // If the line has any text in it: expand history, save it to history and resolve aliases
+    // If the line has any text in it: expand history and save it to history
     //  (readline returns NULL iff EOF on a blank line)
     if (buf && *buf) {
         printdebug("You entered: '%s'", buf);
-        // do history expansion
+        // do history expansion, iff the line may contain a history reference
         char *expansion = "";
         int hist_rv;
-        if ((hist_rv = history_expand(buf, &expansion)) != -1) {
+        if (!strchr(buf, history_expansion_char) && *buf != history_subst_char)
+            printdebug("readcmd: no history expansion needed");
+        else if ((hist_rv = history_expand(buf, &expansion)) != -1) {
             if (hist_rv == 1)
                 printf("%s\n", expansion);  // bash-style print the expanded command string iff changed
             free(buf);                      // free unexpanded version
@@ -628,9 +379,8 @@ char *readcmd(int status) {
         }
         add_history(buf);
         nb_hist_entries++;
-        char *ret = resolvealiases(buf);
-        free(buf); // free unresolved version
-        buf = ret; // point to resolved cmd
+        if (strstr(buf, "sudo"))
+            prompt_invalidate_privileges();     // e.g. 'sudo -v' or 'sudo -k'
     }
     else if (!buf) {
         printf("\n");
@@ -703,6 +453,12 @@ int parse_built_in(comd *comd, int index) {
                 return alias(comd->cmd[1], comd->cmd[2]);
             }
             break;
+        case BG:
+            // the optional job spec defaults to the current job
+            if (comd->length > 2)
+                CHK_ARGC("bg", 1);
+            return jobs_bg(comd->cmd[1]);
+            break;
         case CD:
             { // to allow declarions inside a switch)
             char *dir;
@@ -712,8 +468,7 @@ int parse_built_in(comd *comd, int index) {
                 CHK_ARGC("cd",1);
                 dir = comd->cmd[1];
             }
-            CHK_ERR(chdir(dir), "cd");
-            setenv("PWD", dir, 1);
+            CHK_ERR(state_chdir(dir), "cd");
             return EXIT_SUCCESS;
             break;
             }
@@ -726,6 +481,28 @@ int parse_built_in(comd *comd, int index) {
         case EXIT:
             exit(EXIT_SUCCESS);
             break;
+        case FG:
+            // the optional job spec defaults to the current job
+            if (comd->length > 2)
+                CHK_ARGC("fg", 1);
+            return jobs_fg(comd->cmd[1]);
+            break;
+        case FUNCS:
+            CHK_ARGC("functions", 0);
+            func_print();
+            return EXIT_SUCCESS;
+            break;
+        case HASH:
+            // check for the optional argument
+            // -r: forget all cached cmd paths
+            if (comd->length == 2 && strcmp(comd->cmd[1], "-r") == 0) {
+                path_flush();
+                return EXIT_SUCCESS;
+            }
+            CHK_ARGC("hash", 0);
+            path_print();
+            return EXIT_SUCCESS;
+            break;
         case HIST:
             // check for the optional argument
             // nb-entries: print the number of hist entries in the current session
@@ -744,8 +521,49 @@ int parse_built_in(comd *comd, int index) {
                     printf ("%s\n", hlist[i]->line);
             return EXIT_SUCCESS;
             break;
+        case JOBS:
+            CHK_ARGC("jobs", 0);
+            jobs_print();
+            return EXIT_SUCCESS;
+            break;
+        case PARALLEL:
+            return parallel(comd->cmd, comd->length);
+            break;
+        case PIPESTATUS:
+            CHK_ARGC("pipestatus", 0);
+            print_pipestatus();
+            return EXIT_SUCCESS;
+            break;
         case PROMPT:
             {
+            // check for the async prompt toggle option
+            if (comd->length >= 2 && strcmp(comd->cmd[1], "--async") == 0) {
+                CHK_ARGC("prompt --async", 2);
+                comd->cmd++;
+                comd->length--;
+                TOGGLE_VAR("async prompt", ASYNC_PROMPT, comd->cmd[1]);
+            }
+            else if (comd->length >= 2 && strcmp(comd->cmd[1], "--sudo-ttl") == 0) {
+                CHK_ARGC("prompt --sudo-ttl", 2);
+                SUDO_TTL = abs(atoi(comd->cmd[2]));     // will return 0 on non-integer
+                printdebug("setting SUDO_TTL to %d", SUDO_TTL);
+                return EXIT_SUCCESS;
+            }
+            else if (comd->length >= 2 && strcmp(comd->cmd[1], "--profile") == 0) {
+                if (comd->length == 2) {
+                    prompt_print_profile();
+                    return EXIT_SUCCESS;
+                }
+                CHK_ARGC("prompt --profile", 2);
+                comd->cmd++;
+                comd->length--;
+                TOGGLE_VAR("prompt profile", PROFILE_PROMPT, comd->cmd[1]);
+            }
+            else if (comd->length >= 2 && strcmp(comd->cmd[1], "--stats") == 0) {
+                CHK_ARGC("prompt --stats", 1);
+                prompt_print_stats();
+                return EXIT_SUCCESS;
+            }
             // check for the optional dir length argument
             if (comd->length == 3) {
                 MAX_DIR_LENGTH = abs(atoi(comd->cmd[2]));    // will return 0 on non-integer
@@ -754,26 +572,74 @@ int parse_built_in(comd *comd, int index) {
             else
                 CHK_ARGC("prompt", 1);
             
-            free(user_prompt_string);
-            char *newprompt = resolve_prompt_colors(comd->cmd[1]);
-            printdebug("setting user_prompt_string to '%s'", newprompt);
-            user_prompt_string = newprompt;
+            prompt_set(comd->cmd[1]);
             return EXIT_SUCCESS;
             break;
             }
+        case SET:
+            // no arguments: print the current value of all settings
+            if (comd->length == 1) {
+                printf("maxdepth %d\n", MAX_DEPTH);
+                printf("spawn %s\n", USE_SPAWN ? "on" : "off");
+                printf("pipefail %s\n", PIPEFAIL ? "on" : "off");
+                printf("pipesize %d\n", PIPE_SIZE);
+                printf("parsecache %d\n", PARSE_CACHE_SIZE);
+                return EXIT_SUCCESS;
+            }
+            CHK_ARGC("set", 2);
+            if (strcmp(comd->cmd[1], "spawn") == 0) {
+                comd->cmd++;
+                comd->length--;
+                TOGGLE_VAR("spawn", USE_SPAWN, comd->cmd[1]);
+            }
+            if (strcmp(comd->cmd[1], "pipefail") == 0) {
+                comd->cmd++;
+                comd->length--;
+                TOGGLE_VAR("pipefail", PIPEFAIL, comd->cmd[1]);
+            }
+            if (strcmp(comd->cmd[1], "pipesize") == 0)
+                return set_pipe_size(comd->cmd[2]);
+            if (strcmp(comd->cmd[1], "parsecache") == 0)
+                return cache_set_size(comd->cmd[2]);
+            if (strcmp(comd->cmd[1], "maxdepth") == 0) {
+                MAX_DEPTH = abs(atoi(comd->cmd[2]));    // will return 0 on non-integer
+                cache_flush();                          // the cached trees were parsed with the old limit
+                printdebug("setting MAX_DEPTH to %d", MAX_DEPTH);
+                return EXIT_SUCCESS;
+            }
+            printerr("set: unrecognized setting '%s'", comd->cmd[1]);
+            return EXIT_FAILURE;
+            break;
         case SHCAT:
-            parsestream(stdin, "stdin", (void (*)(char*)) puts_verbatim);  // built_in cat; mainly for testing purposes (redirecting stdin)
+            // built_in cat; mainly for testing purposes (redirecting stdin)
+            fflush(stdout);
+            return copystream(STDIN_FILENO, STDOUT_FILENO, "shcat");
+            break;
+        case STATS:
+            CHK_ARGC("stats", 0);
+            cache_print_stats();
             return EXIT_SUCCESS;
             break;
         case UNALIAS:
             CHK_ARGC("unalias", 1);
             return unalias(comd->cmd[1]);
+            break;
+        case UNFUNC:
+            CHK_ARGC("unfunction", 1);
+            return func_undefine(comd->cmd[1]);
             break;
 		case SRC:
 			CHK_ARGC("source", 1);
-			parsefile(comd->cmd[1], (void (*)(char*)) parse_from_file, true); // errormsg if file not found
+			parsefile(comd->cmd[1], (void (*)(char*)) parseexpr, true); // errormsg if file not found
+			parse_end_input(comd->cmd[1]);
 			return EXIT_SUCCESS;
 			break;
+        case WAIT:
+            // without a job spec: wait for all jobs
+            if (comd->length > 2)
+                CHK_ARGC("wait", 1);
+            return jobs_wait(comd->cmd[1]);
+            break;
         default:
             printerr("parse_built_in: unrecognized built_in command: '%s' with index %d", *comd->cmd, index);
 			exit(EXIT_FAILURE);